@@ -1,418 +1,1958 @@
-/*
- * alarm_mutex.c
- *
- * This is an enhancement to the alarm_thread.c program, which
- * created an "alarm thread" for each alarm command. This new
- * version uses a single alarm thread, which reads the next
- * entry in a list. The main thread places new requests onto the
- * list, in order of absolute expiration time. The list is
- * protected by a mutex, and the alarm thread sleeps for at
- * least 1 second, each iteration, to ensure that the main
- * thread can lock the mutex to add new work to the list.
- */
-#include <pthread.h>
-#include <time.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <ctype.h>
-#include "errors.h"
-
-/*
- * The "alarm" structure now contains the time_t (time since the
- * Epoch, in seconds) for each alarm, so that they can be
- * sorted. Storing the requested number of seconds would not be
- * enough, since the "alarm thread" cannot tell how long it has
- * been on the list.
- */
-typedef struct alarm_tag {
-    struct alarm_tag    *link; //link to next alarm in list
-    int                 alarm_id; // unique alarm ID to identify and edit
-    int 				seconds; // will use this to measure time
-    char* 				type; // type in string format, does not include T at start
-    time_t              time;   /* seconds from EPOCH */
-    char                message[64];
-} alarm_t;
-
-pthread_mutex_t alarm_mutex = PTHREAD_MUTEX_INITIALIZER;
-alarm_t *alarm_list = NULL;
-
-//____ THREADS ____
-
-/*
- * The alarm thread's start routine.
- */
-void *alarm_thread (void *arg)
-{
-    alarm_t *alarm;
-    int sleep_time;
-    time_t now;
-    int status;
-
-    /*
-     * Loop forever, processing commands. The alarm thread will
-     * be disintegrated when the process exits.
-     */
-    while (1) {
-        status = pthread_mutex_lock (&alarm_mutex);
-        if (status != 0)
-            err_abort (status, "Lock mutex");
-        alarm = alarm_list;
-
-        /*
-         * If the alarm list is empty, wait for one second. This
-         * allows the main thread to run, and read another
-         * command. If the list is not empty, remove the first
-         * item. Compute the number of seconds to wait -- if the
-         * result is less than 0 (the time has passed), then set
-         * the sleep_time to 0.
-         */
-        if (alarm == NULL)
-            sleep_time = 1;
-        else {
-            alarm_list = alarm->link;
-            now = time (NULL);
-            if (alarm->time <= now)
-                sleep_time = 0;
-            else
-                sleep_time = alarm->time - now;
-#ifdef DEBUG
-            printf ("[waiting: %d(%d)\"%s\"]\n", alarm->time,
-                sleep_time, alarm->message);
-#endif
-            }
-
-        /*
-         * Unlock the mutex before waiting, so that the main
-         * thread can lock it to insert a new alarm request. If
-         * the sleep_time is 0, then call sched_yield, giving
-         * the main thread a chance to run if it has been
-         * readied by user input, without delaying the message
-         * if there's no input.
-         */
-        status = pthread_mutex_unlock (&alarm_mutex);
-        if (status != 0)
-            err_abort (status, "Unlock mutex");
-        if (sleep_time > 0)
-            sleep (sleep_time);
-        else
-            sched_yield ();
-
-        /*
-         * If a timer expired, print the message and free the
-         * structure.
-         */
-        if (alarm != NULL) {
-            printf ("(%d) %s\n", alarm->seconds, alarm->message);
-            free (alarm);
-        }
-    }
-}
-
-//____ FUNCTIONS ____
-
-// Function to trim leading and trailing whitespace
-// Code provided by Adam Rosenfield and Dave Gray on StackOverflow
-char *trimwhitespace(char *str)
-{
-  char *end;
-
-  // Trim leading space
-  while(isspace((unsigned char)*str)) str++;
-
-  if(*str == 0)  // All spaces?
-    return str;
-
-  // Trim trailing space
-  end = str + strlen(str) - 1;
-  while(end > str && isspace((unsigned char)*end)) end--;
-
-  // Write new null terminator character
-  end[1] = '\0';
-
-  return str;
-}
-
-// Function is called when user enters command for Start_Alarm
-// Creates new alarm based on inputs, and then adds to alarm list
-void Start_Alarm (int alarm_id, char* type, int seconds, const char* message){
-    alarm_t *alarm, **last, *next; // pointers for alarms in list
-    int status; // for checking mutex status
-    printf("Starting Alarm %d\n", alarm_id);
-    
-    // Malloc for new alarm 
-    // MUST FREE MEMORY ONCE ALARM EXPIRES
-    alarm = (alarm_t*)malloc(sizeof(alarm_t));
-    if (alarm == NULL){
-		free (alarm);
-        perror("Allocate Alarm");
-    }
-    alarm->alarm_id = alarm_id;
-    alarm->type = type;
-    alarm->seconds = seconds;
-    alarm->time = time(NULL) + seconds; // current time + seconds
-    strcpy(alarm->message, message); // copy string into the struct
-    alarm->link = NULL;
-
-    // lock mutex before operation
-    status = pthread_mutex_lock(&alarm_mutex);
-    if (status != 0){
-        err_abort (status, "Lock Mutex");
-    }
-    
-    last = &alarm_list;
-    next = *last;
-
-    while(next!= NULL){
-        // compare items in list until current alarm_id is greater than last
-        if (next->alarm_id >= alarm_id){
-            alarm->link = next; //position found. Link alarm
-            break;
-        }
-        last = &next->link; // move to next position in list
-        next = next->link;
-    }
-    alarm_list = alarm; // insert new alarm at found position
-
-    //printf("Successfully added alarm %d to list.\n", alarm->alarm_id);
-
-    // unlock mutex after operation
-    status = pthread_mutex_unlock(&alarm_mutex);
-    if (status != 0){
-        err_abort (status, "Unlock Mutex");
-    }
-    
-}
-void Change_Alarm (int alarm_id, char* type, int seconds, const char* message){
-        alarm_t *alarm; // pointer for new alarm
-        int status; // for checking mutex status
-		printf("Changing alarm %d to T%s, %d, %s\n", alarm_id, type, seconds, message);
-
-        // lock mutex
-        status = pthread_mutex_lock(&alarm_mutex);
-        if (status != 0){
-            err_abort (status, "Lock Mutex");
-        }
-
-        // search for matching alarm based on alarm_id
-        alarm = alarm_list;
-        while (alarm != NULL){
-            if (alarm->alarm_id == alarm_id){
-                // found the alarm. Update fields
-                strcpy(alarm->type, type);
-                alarm->type[sizeof(alarm->type)-1] = '\0'; // set last value as terminator
-                alarm->seconds = seconds;
-                alarm->time = time(NULL) + seconds; // based on current time
-                strcpy(alarm->message, message);
-                alarm->message[sizeof(alarm->message)-1] = '\0'; // terminate string
-
-                //printf("Alarm %d has been changed to T%s %d %s.\n", alarm_id, type, seconds, message);
-                break;
-            }
-            // didn't find. move to next in list
-            alarm = alarm->link;
-        }
-
-        if (alarm == NULL){
-            // this alarm_id doesn't exist in the list
-            printf("Could not find alarm %d\n", alarm_id);
-        }
-
-        // unlock mutex
-        status = pthread_mutex_unlock(&alarm_mutex);
-        if (status != 0){
-            err_abort (status, "Unlock Mutex");
-        }
-	}
-
-void Cancel_Alarm (int alarm_id){
-    alarm_t *alarm, *prev;
-    int status;
-
-    printf("Canceling alarm %d\n", alarm_id);
-    //free(alarm);
-
-    // lock mutex
-    status = pthread_mutex_lock(&alarm_mutex);
-    if (status != 0){
-        err_abort (status, "Lock Mutex");
-    }
-
-    // search for alarm in alarm_list to cancel
-    prev = NULL;
-    alarm = alarm_list;
-
-    while (alarm != NULL){
-        if (alarm->alarm_id == alarm_id){
-            // found alarm. remove from list
-            if (prev == NULL){
-                // alarm is the first in list. make link the new head
-                alarm_list = alarm->link;
-            } else {
-                prev->link = alarm->link;
-            }
-            // free memory
-            free(alarm);
-            break;
-        }
-        // move to next alarm in list
-        prev = alarm;
-        alarm = alarm->link;
-    }
-
-    if (alarm == NULL){
-        // alarm to find does not exist
-        printf("Alarm %d does not exist.\n", alarm_id);
-    }
-
-    // unlock mutex
-    status = pthread_mutex_unlock(&alarm_mutex);
-    if (status != 0){
-        err_abort (status, "Unlock Mutex");
-    }    
-}
-
-void View_Alarms(){
-    alarm_t *alarm;
-    int status;
-    time_t now;
-    int time_left;
-
-    printf("Viewing Alarms\n");
-    
-    // lock mutex
-    status = pthread_mutex_lock(&alarm_mutex);
-    if (status != 0){
-        err_abort (status, "Lock Mutex");
-    }
-
-    // get current time. needed when time changes
-    now = time(NULL);
-
-    // check alarm list
-    if (alarm_list == NULL){
-        printf("There are no alarms.\n");
-    } else {
-        // go through each alarm in list
-        for (alarm = alarm_list; alarm != NULL; alarm = alarm->link){
-            time_left = (int)(alarm->time - now);
-            printf("Alarm(%d): T%s %d time left: %d seconds. Message: %s",
-            alarm->alarm_id, alarm->type, alarm->seconds, time_left, alarm->message);
-        }
-    }
-
-    // unlock mutex
-    status = pthread_mutex_unlock(&alarm_mutex);
-    if (status != 0){
-        err_abort (status, "Unlock Mutex");
-    }
-}
-
-// Below is the main function/thread
-int main (int argc, char *argv[])
-{
-    int status;
-    char sline[128];
-    char line[128];
-    alarm_t *alarm, **last, *next;
-    int alarm_id; // declare the alarm's unique id
-    char type[65] = "";
-    int seconds; // time in seconds
-    char message[65] = "";
-    pthread_t thread;
-
-    status = pthread_create (&thread, NULL, alarm_thread, NULL);
-    if (status != 0)
-        err_abort (status, "Create alarm thread");
-    while (1) {
-        printf ("alarm> ");
-        if (fgets (sline, sizeof (sline), stdin) == NULL) exit (0);
-        if (strlen (sline) <= 1) continue;
-        alarm = (alarm_t*)malloc (sizeof (alarm_t));
-        if (alarm == NULL)
-            errno_abort ("Allocate alarm");
-
-        // remove unnecessary white space around line (stdin)
-        strcpy(line, trimwhitespace(sline));
-        
-        // check which function was called
-        if (sscanf(line, "Start_Alarm(%d): T%s %d %128[^\n]", 
-            &alarm_id, type, &seconds, message) > 3){
-            Start_Alarm(alarm_id, type, seconds, message);
-            printf("Alarm(%d) Inserted by Main Thread(<thread-id>) Into Alarm List at %d: T%s %d %s",
-            alarm_id, (int)time(NULL), type, seconds, message);
-
-            // Change Alarm function call
-        } else if (sscanf(line, "Change_Alarm(%d): T%s %d %128[^\n]", 
-            &alarm_id, type, &seconds, message) > 3){
-            Change_Alarm(alarm_id, type, seconds, message);
-            printf("Alarm(%d) Changed at %d: T%s %d %s",
-            alarm_id, (int)time(NULL), type, seconds, message);
-
-            // Cancel Alarm function call
-        } else if (sscanf(line, "Cancel_Alarm(%d)", 
-            &alarm_id) == 1){
-            Cancel_Alarm(alarm_id);
-            printf("Alarm(%d) Cancelled at %d: T%s %d %s",
-            alarm_id, (int)time(NULL), type, seconds, message);
-
-            // View Alarms function call. Uses specifically string compare, not sscanf
-            // There are no variables to compare, only exact copy of a string
-        } else if (strcmp(line, "View_Alarms()") == 0){
-                View_Alarms();
-        /*
-         * Parse input line into seconds (%d) and a message
-         * (%64[^\n]), consisting of up to 64 characters
-         * separated from the seconds by whitespace.
-         */
-        } else if (sscanf (line, "%d %64[^\n]", 
-            &alarm->seconds, alarm->message) < 2) {
-            printf("Bad command\n");
-            //fprintf (stderr, "Bad command\n");
-            free (alarm);
-        } else {
-            status = pthread_mutex_lock (&alarm_mutex);
-            if (status != 0)
-                err_abort (status, "Lock mutex");
-            alarm->time = time (NULL) + alarm->seconds;
-
-            /*
-             * Insert the new alarm into the list of alarms,
-             * sorted by expiration time.
-             */
-             printf("else");
-            last = &alarm_list;
-            next = *last;
-            while (next != NULL) {
-				printf("while");
-                if (next->time >= alarm->time) {
-                    alarm->link = next;
-                    *last = alarm;
-                    break;
-                }
-                last = &next->link;
-                next = next->link;
-            }
-            /*
-             * If we reached the end of the list, insert the new
-             * alarm there. ("next" is NULL, and "last" points
-             * to the link field of the last item, or to the
-             * list header).
-             */
-            if (next == NULL) {
-                *last = alarm;
-                alarm->link = NULL;
-            }
-#ifdef DEBUG
-            printf ("[list: ");
-            for (next = alarm_list; next != NULL; next = next->link)
-                printf ("%d(%d)[\"%s\"] ", next->time,
-                    next->time - time (NULL), next->message);
-            printf ("]\n");
-#endif
-            status = pthread_mutex_unlock (&alarm_mutex);
-            if (status != 0)
-                err_abort (status, "Unlock mutex");
-        }
-    }
-}
+/*
+ * alarm_mutex.c
+ *
+ * This is an enhancement to the alarm_thread.c program, which
+ * created an "alarm thread" for each alarm command. This new
+ * version uses a single alarm thread, which reads the next
+ * entry in a list. The main thread places new requests onto the
+ * list, in order of absolute expiration time. The list is
+ * protected by a mutex, and the alarm thread waits (through an
+ * expiry engine, see alarm_engine.h) until the earliest alarm is
+ * due. The main thread wakes the engine whenever it changes
+ * which alarm is earliest.
+ */
+#include <pthread.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+# include <sys/epoll.h>
+# include <sys/timerfd.h>
+#endif
+#include "errors.h"
+#include "alarm.h"
+#include "alarm_store.h"
+#include "alarm_index.h"
+#include "alarm_slab.h"
+#include "alarm_engine.h"
+#include "alarm_queue.h"
+#include "alarm_parse.h"
+#include "alarm_sink.h"
+#include "alarm_binary.h"
+#include "alarm_server.h"
+#include "alarm_uring.h"
+#include "alarm_type.h"
+#include "alarm_json.h"
+#include "alarm_display.h"
+#include "alarm_lock.h"
+
+/*
+ * The alarms are kept in an alarm store (see alarm_store.h)
+ * rather than a sorted list, so that inserting an alarm does not
+ * have to walk every pending alarm while holding a mutex. The
+ * store is a hierarchical timing wheel unless another backend is
+ * chosen with -s. An alarm index maps each alarm_id to its alarm,
+ * so that commands naming an alarm do not have to search the
+ * store either. The alarm_t structure itself lives in alarm.h.
+ *
+ * The alarms are split across shard_count shards (set with -n)
+ * by hashing the alarm_id. Each shard has its own store, index,
+ * mutex, expiry engine and alarm thread, so commands for
+ * different shards do not contend with each other. The mutex
+ * protects everything else in the shard.
+ *
+ * Start_Alarm, Change_Alarm and Cancel_Alarm do not take the
+ * shard mutex. They push a command onto the shard's lock-free
+ * command queue (see alarm_queue.h) and return, so reading input
+ * never waits behind an alarm thread that is busy expiring
+ * alarms. Whoever holds the mutex next applies the queued
+ * commands in one batch: normally the shard's alarm thread, or
+ * View_Alarms, which has to see every command typed before it.
+ * "sleeping" is set while the alarm thread waits in its engine,
+ * so that a producer only has to kick the engine when there is
+ * nobody awake to notice the command.
+ *
+ * "version" and "snapshot" let View_Alarms copy the store only
+ * when it has changed (see shard_snapshot).
+ *
+ * current_alarm is the time the shard's alarm thread is waiting
+ * for (0 if it is waiting for the store to become non-empty). It
+ * lets alarm_reschedule tell whether a change to the store moved
+ * the earliest deadline.
+ *
+ * The alarm thread takes every due alarm out of the store at once
+ * and delivers the whole batch after unlocking. The batch
+ * counters record how large those batches are; batch_hist[i]
+ * counts the batches of 2^i to 2^(i+1)-1 alarms (the last bucket
+ * holds everything larger). They are reported when the program
+ * exits. With -w, the alarm thread hands the batch to the display
+ * workers (see alarm_display.h) instead of formatting it itself.
+ *
+ * With -1 (Linux only) there are no alarm threads at all: the
+ * main thread runs event_loop, which waits in epoll for both
+ * stdin and a timerfd armed to the earliest deadline of any
+ * shard. Everything then happens on that one thread, so commands
+ * are applied to the stores directly rather than queued, and
+ * shard_lock and shard_unlock do nothing. It is there to compare
+ * the single-core throughput of the two models.
+ */
+#define BATCH_HIST      16
+
+typedef struct shard_tag {
+    lock_t              lock;
+    alarm_store_t       store;
+    alarm_index_t       index;
+    engine_t            engine;
+    uint64_t            current_alarm;
+    pthread_t           thread;
+    command_queue_t     queue;
+    int                 sleeping;
+    unsigned long       version;    /* bumped when the store changes */
+    struct snapshot_tag *snapshot;  /* latest View snapshot, or NULL */
+    unsigned long       batches;    /* batches delivered */
+    unsigned long       delivered;  /* alarms in those batches */
+    int                 batch_max;
+    unsigned long       batch_hist[BATCH_HIST];
+} shard_t;
+
+shard_t *shards;
+int shard_count = 1;
+int single = 0;     /* -1: one thread, no locking */
+
+/*
+ * Return the shard that owns alarm_id. The multiplicative hash
+ * spreads sequential IDs across shards, and the multiply-shift
+ * maps the hash onto [0, shard_count) without a division.
+ */
+static shard_t *shard_of (int alarm_id)
+{
+    uint32_t hash = (uint32_t)alarm_id * 2654435769U;
+
+    return &shards[((uint64_t)hash * shard_count) >> 32];
+}
+
+/*
+ * The shard mutex is an instrumented lock (see alarm_lock.h):
+ * "site" says who is taking it, for the Stats command.
+ */
+static void shard_lock (shard_t *shard, lock_site_t site)
+{
+    if (single)
+        return;
+    lock_acquire (&shard->lock, site);
+}
+
+static void shard_unlock (shard_t *shard)
+{
+    if (single)
+        return;
+    lock_release (&shard->lock);
+}
+
+static int shard_drain (shard_t *shard);
+static void apply_command (shard_t *shard, const command_t *command);
+
+//____ THREADS ____
+
+/*
+ * Record a batch of "size" alarms in the shard's batch counters.
+ * Called with the shard mutex held.
+ */
+static void batch_count (shard_t *shard, int size)
+{
+    int bucket = 0;
+
+    while (bucket < BATCH_HIST - 1 && (size >> (bucket + 1)) != 0)
+        bucket++;
+    shard->batches++;
+    shard->delivered += size;
+    if (size > shard->batch_max)
+        shard->batch_max = size;
+    shard->batch_hist[bucket]++;
+}
+
+/*
+ * Print the batch counters of every shard, summed, to stderr.
+ * Registered with atexit.
+ */
+static void batch_report (void)
+{
+    unsigned long batches = 0, delivered = 0, hist[BATCH_HIST] = { 0 };
+    int max = 0, i, j;
+
+    for (i = 0; i < shard_count; i++) {
+        shard_lock (&shards[i], LOCK_REPORT);
+        batches += shards[i].batches;
+        delivered += shards[i].delivered;
+        if (shards[i].batch_max > max)
+            max = shards[i].batch_max;
+        for (j = 0; j < BATCH_HIST; j++)
+            hist[j] += shards[i].batch_hist[j];
+        shard_unlock (&shards[i]);
+    }
+    if (batches == 0)
+        return;
+    fprintf (stderr, "%lu alarms in %lu batches (mean %.2f, max %d)\n",
+        delivered, batches, (double)delivered / batches, max);
+    for (j = 0; j < BATCH_HIST; j++)
+        if (hist[j] != 0)
+            fprintf (stderr, "  %6lu-%-6lu %lu\n", 1UL << j,
+                j == BATCH_HIST - 1 ? (unsigned long)max : (2UL << j) - 1,
+                hist[j]);
+}
+
+/*
+ * Print the shard locks' wait and hold histograms to stderr.
+ * Registered with atexit, unless there are no locks (-1).
+ */
+static void lock_report (void)
+{
+    lock_stats (stderr);
+}
+
+/*
+ * Longest line an alarm can print: "(<duration>) <message>\n".
+ */
+#define OUTPUT_LINE     128
+
+/*
+ * A batch of due alarms, chained through "link", has just been
+ * taken off the shard's store. Drop them from the index too, so
+ * that no command can reach them once the mutex is released, and
+ * count the batch. Called with the shard mutex held.
+ */
+static void batch_detach (shard_t *shard, alarm_t *batch)
+{
+    alarm_t *alarm;
+    int size = 0;
+
+    for (alarm = batch; alarm != NULL; alarm = alarm->link) {
+        if (index_find (&shard->index, alarm->alarm_id) == alarm)
+            index_remove (&shard->index, alarm->alarm_id);
+        size++;
+    }
+    shard->version++;
+    batch_count (shard, size);
+}
+
+/*
+ * Where delivered alarm messages go: the output sink, unless one
+ * of the single-threaded loops writes them itself.
+ */
+static void (*deliver_write) (const char *text, size_t length,
+    int messages) = sink_write;
+
+/*
+ * With -j, what happens to alarms is written as JSON lines (see
+ * alarm_json.h) through deliver_write: "inserted", "changed",
+ * "cancelled" and "expired" events, whichever way the command
+ * came in, and a "view" event for each row View_Alarms lists.
+ * The rest of the echo, which is not an event, goes to stderr
+ * instead (see echo), so that stdout is nothing but JSON.
+ */
+int json = 0;
+
+/*
+ * Add the fields every alarm event has.
+ */
+static void json_fields (json_t *out, int alarm_id, uint16_t type,
+    uint64_t duration, uint64_t time, const char *message)
+{
+    json_int (out, "alarm_id", alarm_id);
+    json_string (out, "type", type_name (type));
+    json_uint (out, "duration_ns", duration);
+    json_uint (out, "deadline_ns", time);
+    json_string (out, "message", message);
+}
+
+/*
+ * Start a JSON event about "alarm" in "buffer", which must have
+ * room for JSON_LINE bytes. The caller may add fields, and ends
+ * it with json_end.
+ */
+static void json_alarm (json_t *out, char *buffer, const char *event,
+    const alarm_t *alarm, uint64_t mono, uint64_t wall)
+{
+    json_begin (out, buffer, event, mono, wall);
+    json_fields (out, alarm->alarm_id, alarm->type, alarm->duration,
+        alarm->time, alarm->message);
+}
+
+/*
+ * Write a single JSON event about "alarm", happening now.
+ */
+static void json_event (const char *event, const alarm_t *alarm)
+{
+    char buffer[JSON_LINE];
+    json_t out;
+
+    json_alarm (&out, buffer, event, alarm, alarm_now (), alarm_wall ());
+    deliver_write (buffer, json_end (&out), 1);
+}
+
+/*
+ * Print the echo of a command, a prompt or a View row. Without -j
+ * it goes through deliver_write like the alarm messages, so that
+ * only one writer ever touches stdout and a line of echo cannot be
+ * spliced into the middle of a message; it is not a message, so
+ * it is never dropped. With -j it goes to stderr.
+ */
+static void echo_text (const char *text, size_t length)
+{
+    if (json)
+        fwrite (text, 1, length, stderr);
+    else
+        deliver_write (text, length, 0);
+}
+
+static void echo_printf (const char *format, ...)
+{
+    char text[256];
+    va_list args;
+    int length;
+
+    va_start (args, format);
+    length = vsnprintf (text, sizeof (text), format, args);
+    va_end (args);
+    if (length >= (int)sizeof (text))
+        length = sizeof (text) - 1;
+    if (length > 0)
+        echo_text (text, length);
+}
+
+/*
+ * Where the text of View_Alarms and Stats() goes: NULL for the
+ * echo and the output, or a socket client's server_reply.
+ */
+typedef void (*reply_t) (const char *text, size_t length);
+
+/*
+ * Echo, or reply to the client whose command it is.
+ */
+static void reply_text (reply_t reply, const char *text, size_t length)
+{
+    if (reply != NULL)
+        reply (text, length);
+    else
+        echo_text (text, length);
+}
+
+/*
+ * Stats(): the lock histograms, as echo or a reply.
+ */
+static void echo_stats (reply_t reply)
+{
+    char *text = NULL;
+    size_t length = 0;
+    FILE *out;
+
+    out = open_memstream (&text, &length);
+    if (out == NULL)
+        errno_abort ("Open stats buffer");
+    lock_stats (out);
+    fclose (out);
+    reply_text (reply, text, length);
+    free (text);
+}
+
+/*
+ * Format the messages of a detached batch, return the structures
+ * to the slab allocator, and hand the text to the output sink a
+ * bufferful at a time. Called without the shard mutex.
+ */
+static void batch_deliver (alarm_t *batch)
+{
+    alarm_t *alarm, *next;
+    char duration[32], output[16384];
+    size_t length = 0, room = json ? JSON_LINE : OUTPUT_LINE;
+    uint64_t mono = 0, wall = 0;
+    json_t out;
+    int size = 0;
+
+    // the whole batch expired at once
+    if (json) {
+        mono = alarm_now ();
+        wall = alarm_wall ();
+    }
+    for (alarm = batch; alarm != NULL; alarm = next) {
+        next = alarm->link;
+        if (length > sizeof (output) - room) {
+            deliver_write (output, length, size);
+            length = 0;
+            size = 0;
+        }
+        if (json) {
+            json_alarm (&out, output + length, "expired", alarm, mono, wall);
+            length += json_end (&out);
+        } else
+            length += snprintf (output + length, sizeof (output) - length,
+                "(%s) %s\n", duration_format (duration, sizeof (duration),
+                alarm->duration), alarm->message);
+        size++;
+        alarm_free (alarm);
+    }
+    deliver_write (output, length, size);
+}
+
+/*
+ * The most display workers there may be (-w), or 0 to have the alarm
+ * threads deliver their own batches; -1 until main has decided.
+ */
+int display_workers = -1;
+
+/*
+ * The alarm thread's start routine. There is one alarm thread
+ * per shard, passed in "arg".
+ */
+void *alarm_thread (void *arg)
+{
+    shard_t *shard = (shard_t*)arg;
+    alarm_t *batch;
+    uint64_t now, when;
+
+    /*
+     * Loop forever, processing commands. The alarm thread will
+     * be disintegrated when the process exits.
+     */
+    while (1) {
+        shard_lock (shard, LOCK_ALARM_THREAD);
+
+        /*
+         * Wait until an alarm is due. If the store is empty,
+         * wait until a command is queued. Otherwise wait until
+         * the time at which the store next needs attention (an
+         * alarm expires, or for the wheel, a higher level must
+         * be cascaded), or until a command is queued or an
+         * earlier alarm is inserted and the engine is woken.
+         * Either way, look again afterwards. Commands queued
+         * for the shard are applied first, each time round.
+         */
+        while (1) {
+            shard_drain (shard);
+            now = alarm_now ();
+            batch = store_expire (&shard->store, now);
+            if (batch != NULL)
+                break;
+            if (!store_next (&shard->store, &when))
+                when = 0;
+            shard->current_alarm = when;
+#ifdef DEBUG
+            echo_printf ("[shard %d waiting: %d alarms, until %llu]\n",
+                (int)(shard - shards), store_count (&shard->store),
+                (unsigned long long)when);
+#endif
+
+            /*
+             * Announce that we are going to sleep before the last
+             * look at the queue. A producer pushes before it looks
+             * at "sleeping", so either we see its command here or
+             * it sees the flag and kicks the engine.
+             */
+            __atomic_store_n (&shard->sleeping, 1, __ATOMIC_RELAXED);
+            __atomic_thread_fence (__ATOMIC_SEQ_CST);
+            if (queue_empty (&shard->queue))
+                engine_wait (&shard->engine, &shard->lock, when);
+            __atomic_store_n (&shard->sleeping, 0, __ATOMIC_RELAXED);
+        }
+
+        /*
+         * The whole run of due alarms is now off the store.
+         */
+        batch_detach (shard, batch);
+        shard_unlock (shard);
+        if (display_workers != 0)
+            display_submit ((int)(shard - shards), batch);
+        else
+            batch_deliver (batch);
+    }
+}
+
+//____ FUNCTIONS ____
+
+/*
+ * Called with the shard's mutex locked after its store has
+ * changed. If the earliest deadline is no longer the one the
+ * shard's alarm thread is waiting for, wake the engine so that it
+ * waits for the new one. Changes that leave the head alone do not
+ * wake it at all.
+ */
+static void alarm_reschedule (shard_t *shard){
+    uint64_t when;
+
+    if (single) // event_loop looks at the stores itself
+        return;
+    if (!store_next(&shard->store, &when))
+        when = 0;
+    if (when != shard->current_alarm){
+        shard->current_alarm = when;
+        engine_wake(&shard->engine, when);
+    }
+}
+
+// Queue a command for the shard. Does not take the shard mutex,
+// except to kick a sleeping alarm thread on the cond engine. If
+// the queue is full, kick the alarm thread and give it a chance
+// to drain the queue before trying again.
+static void shard_submit (shard_t *shard, command_op_t op, int alarm_id,
+    alarm_t *alarm, int echo){
+    lock_site_t site = op == CMD_START ? LOCK_START
+        : op == CMD_CHANGE ? LOCK_CHANGE : LOCK_CANCEL;
+    command_t command;
+
+    command.op = op;
+    command.alarm_id = alarm_id;
+    command.alarm = alarm;
+    command.echo = echo;
+    if (single){
+        apply_command(shard, &command);
+        return;
+    }
+    while (!queue_push(&shard->queue, &command)){
+        engine_kick(&shard->engine, &shard->lock, site);
+        sched_yield();
+    }
+
+    // pairs with the fence in alarm_thread (see there)
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&shard->sleeping, __ATOMIC_RELAXED))
+        engine_kick(&shard->engine, &shard->lock, site);
+}
+
+// Applies a queued Start_Alarm. alarm_id must be unique. If it is,
+// insert the alarm ordered by its expiration time. Legacy alarms
+// (alarm_id -1) are not indexed. "echo" is 0 for commands from a
+// replayed file or a socket.
+static void apply_start (shard_t *shard, alarm_t *alarm, int echo){
+    char duration[32];
+
+    if (alarm->alarm_id == -1){
+        store_insert(&shard->store, alarm);
+        if (json)
+            json_event("inserted", alarm);
+        return;
+    }
+    if (!index_insert(&shard->index, alarm)){
+        echo_printf("Alarm %d already exists\n", alarm->alarm_id);
+        alarm_free(alarm);
+        return;
+    }
+    store_insert(&shard->store, alarm);
+    if (json)
+        json_event("inserted", alarm);
+    if (echo)
+        echo_printf("Alarm(%d) Inserted by Main Thread(<thread-id>) Into Alarm List at %d: T%s %s %s\n",
+        alarm->alarm_id, (int)time(NULL), type_name(alarm->type),
+        duration_format(duration, sizeof(duration), alarm->duration),
+        alarm->message);
+}
+
+// Applies a queued Change_Alarm. "change" carries the new fields
+// and is freed here.
+static void apply_change (shard_t *shard, int alarm_id, alarm_t *change){
+    alarm_t *alarm;
+
+    // look up matching alarm based on alarm_id
+    alarm = index_find(&shard->index, alarm_id);
+    if (alarm != NULL){
+        // found the alarm. Update fields
+        alarm->type = change->type;
+        alarm->duration = change->duration;
+        alarm->time = change->time; // based on time of the command
+        strcpy(alarm->message, change->message);
+
+        // expiration time changed, so reposition it in place
+        store_update(&shard->store, alarm);
+        if (json)
+            json_event("changed", alarm);
+    } else {
+        // this alarm_id doesn't exist in the store
+        echo_printf("Could not find alarm %d\n", alarm_id);
+    }
+    alarm_free(change);
+}
+
+// Applies a queued Cancel_Alarm.
+static void apply_cancel (shard_t *shard, int alarm_id){
+    alarm_t *alarm;
+
+    // look up alarm to cancel, and drop it from the index
+    alarm = index_remove(&shard->index, alarm_id);
+    if (alarm != NULL){
+        // found alarm. remove from the store and free memory
+        store_remove(&shard->store, alarm);
+        if (json)
+            json_event("cancelled", alarm);
+        alarm_free(alarm);
+    } else {
+        // alarm to find does not exist
+        echo_printf("Alarm %d does not exist.\n", alarm_id);
+    }
+}
+
+// Applies one command to a shard. Called with the shard mutex held.
+static void apply_command (shard_t *shard, const command_t *command){
+    shard->version++;
+    switch (command->op){
+    case CMD_START:
+        apply_start(shard, command->alarm, command->echo);
+        break;
+    case CMD_CHANGE:
+        apply_change(shard, command->alarm_id, command->alarm);
+        break;
+    case CMD_CANCEL:
+        apply_cancel(shard, command->alarm_id);
+        break;
+    }
+}
+
+/*
+ * Apply the commands queued for a shard, in the order they were
+ * queued, and wake the alarm thread if the earliest deadline
+ * moved. Called with the shard mutex held, which makes the caller
+ * the queue's only consumer. At most QUEUE_SIZE commands are
+ * applied at a time, so that a steady stream of commands cannot
+ * hold off expiry for ever. Returns the number applied.
+ */
+static int shard_drain (shard_t *shard){
+    command_t command;
+    int count;
+
+    for (count = 0; count < QUEUE_SIZE; count++){
+        if (!queue_pop(&shard->queue, &command))
+            break;
+        apply_command(shard, &command);
+    }
+    if (count > 0)
+        alarm_reschedule(shard);
+    return count;
+}
+
+// Allocates an alarm from the slab allocator and fills it in. Its
+// deadline is counted from now. "message" must fit in the alarm.
+// The display workers are told about its type here, so that a new
+// type's worker is started by the thread taking commands and not
+// by the alarm thread when the alarm is due.
+// MUST FREE MEMORY ONCE ALARM EXPIRES
+static alarm_t *alarm_create (int alarm_id, uint16_t type, uint64_t duration, const char* message){
+    alarm_t *alarm;
+
+    if (display_workers > 0)
+        display_route(type);
+    alarm = alarm_alloc();
+    alarm->alarm_id = alarm_id;
+    alarm->type = type;
+    alarm->duration = duration;
+    alarm->time = alarm_now() + duration; // current time + duration
+    strcpy(alarm->message, message); // copy string into the struct
+    return alarm;
+}
+
+// Picks the shard for the next legacy alarm. Legacy alarms have no
+// alarm_id to hash, so they are spread round-robin. Both main and
+// the socket server call this, hence the atomic counter.
+static shard_t *legacy_shard (void){
+    static unsigned int next = 0;
+
+    return &shards[__atomic_fetch_add(&next, 1, __ATOMIC_RELAXED) % shard_count];
+}
+
+// Function is called when user enters command for Start_Alarm
+// Creates new alarm based on inputs, and queues it for the store
+void Start_Alarm (int alarm_id, uint16_t type, uint64_t duration, const char* message){
+    echo_printf("Starting Alarm %d\n", alarm_id);
+    shard_submit(shard_of(alarm_id), CMD_START, alarm_id,
+        alarm_create(alarm_id, type, duration, message), 1);
+}
+void Change_Alarm (int alarm_id, uint16_t type, uint64_t duration, const char* message){
+        alarm_t *change; // carries the new fields to the shard
+        char text[32];
+		echo_printf("Changing alarm %d to T%s, %s, %s\n", alarm_id, type_name(type),
+            duration_format(text, sizeof(text), duration), message);
+
+        change = alarm_create(alarm_id, type, duration, message);
+        shard_submit(shard_of(alarm_id), CMD_CHANGE, alarm_id, change, 1);
+	}
+
+void Cancel_Alarm (int alarm_id){
+    echo_printf("Canceling alarm %d\n", alarm_id);
+
+    shard_submit(shard_of(alarm_id), CMD_CANCEL, alarm_id, NULL, 1);
+}
+
+/*
+ * View_Alarms lists the alarms from snapshots of the stores, so
+ * that it only holds the shard mutexes while it takes them, and
+ * sorts, formats and prints with no lock held; a slow terminal
+ * holds up nobody but the View.
+ *
+ * A snapshot is a copy of every alarm in one shard's store, and
+ * is never changed once made. Each shard keeps its latest one,
+ * along with a version number that goes up whenever the store
+ * changes, and only copies the store again if the version has
+ * moved since; otherwise the View just takes another reference to
+ * the snapshot it has. The last reference to go frees it.
+ *
+ * The copy is still made with the mutexes held, and costs time in
+ * proportion to the alarms in the shard: the first View after a
+ * change holds every changed shard's lock for one pass over its
+ * store. Only the fields View prints are copied.
+ */
+typedef struct view_row_tag {
+    uint64_t            time;
+    uint64_t            duration;
+    int                 alarm_id;
+    uint16_t            type;
+    char                message[sizeof (((alarm_t*)0)->message)];
+} view_row_t;
+
+typedef struct snapshot_tag {
+    int                 refs;       /* the shard's, and each View's */
+    unsigned long       version;    /* shard version copied */
+    int                 count;
+    view_row_t          rows[];
+} snapshot_t;
+
+static void snapshot_release (snapshot_t *snapshot){
+    if (snapshot != NULL
+        && __atomic_sub_fetch(&snapshot->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        free(snapshot);
+}
+
+static void snapshot_visit (alarm_t *alarm, void *arg){
+    snapshot_t *snapshot = (snapshot_t*)arg;
+
+    view_row_t *row = &snapshot->rows[snapshot->count++];
+
+    row->time = alarm->time;
+    row->duration = alarm->duration;
+    row->alarm_id = alarm->alarm_id;
+    row->type = alarm->type;
+    strcpy(row->message, alarm->message);
+}
+
+// Returns a reference to a snapshot of the shard's store as it is
+// now. Called with the shard mutex held.
+static snapshot_t *shard_snapshot (shard_t *shard){
+    snapshot_t *snapshot = shard->snapshot;
+
+    if (snapshot == NULL || snapshot->version != shard->version){
+        snapshot_release(snapshot);
+        snapshot = (snapshot_t*)malloc(sizeof(snapshot_t)
+            + store_count(&shard->store) * sizeof(view_row_t));
+        if (snapshot == NULL)
+            errno_abort ("Allocate snapshot");
+        snapshot->refs = 1;
+        snapshot->version = shard->version;
+        snapshot->count = 0;
+        store_foreach(&shard->store, snapshot_visit, snapshot);
+        shard->snapshot = snapshot;
+    }
+    __atomic_add_fetch(&snapshot->refs, 1, __ATOMIC_RELAXED);
+    return snapshot;
+}
+
+// qsort comparator: order by expiration time, then alarm_id
+static int compare_time (const void *a, const void *b){
+    const view_row_t *x = *(view_row_t* const*)a;
+    const view_row_t *y = *(view_row_t* const*)b;
+
+    if (x->time != y->time)
+        return x->time < y->time ? -1 : 1;
+    return (x->alarm_id > y->alarm_id) - (x->alarm_id < y->alarm_id);
+}
+
+// The interned id of the type a parsed command names, or -1. With
+// "intern" a type not seen before is added (or it is -1 if the
+// table is full); without, it is -1. A binary frame names its type
+// by number (see alarm_binary.h), standing for the text type made
+// of those digits; the id found for each number is kept, so only
+// the first frame with a given type has to turn it into text.
+static int parse_type (const parse_t *parse, int intern){
+    static int binary_types[65536]; // interned id + 1, or 0 if not yet
+    char text[8];
+    int type;
+
+    if (parse->type != NULL)
+        return intern ? type_intern(parse->type) : type_lookup(parse->type);
+    if (parse->type_id < 0)
+        return -1;
+    type = __atomic_load_n(&binary_types[parse->type_id], __ATOMIC_ACQUIRE);
+    if (type != 0)
+        return type - 1;
+    snprintf(text, sizeof(text), "%d", parse->type_id);
+    type = intern ? type_intern(text) : type_lookup(text);
+    if (type >= 0)
+        __atomic_store_n(&binary_types[parse->type_id], type + 1,
+            __ATOMIC_RELEASE);
+    return type;
+}
+
+// Room kept in the output buffer for one row, text or JSON
+#define VIEW_LINE       JSON_LINE
+
+// Rows go out with the alarm messages, unless they are a reply
+static void view_write(reply_t reply, const char *text, size_t length){
+    if (reply != NULL)
+        reply(text, length);
+    else
+        deliver_write(text, length, 0);
+}
+
+// Lists the alarms, or only those of the type the View names: the
+// rows as output and the lines around them as echo, or all of it as
+// a reply to "reply" when a socket client asked
+void View_Alarms(const parse_t *parse, reply_t reply){
+    static const char viewing[] = "Viewing Alarms\n";
+    static const char none[] = "There are no alarms.\n";
+    snapshot_t **snapshots;
+    view_row_t *row, **rows;
+    uint64_t now, wall;
+    uint64_t time_left;
+    char duration[32], left[32];
+    char output[16384]; // rows, written a bufferful at a time
+    size_t length = 0;
+    json_t out;
+    int i, j, total, count, filter;
+
+    reply_text(reply, viewing, sizeof(viewing) - 1);
+    snapshots = (snapshot_t**)malloc(shard_count * sizeof(snapshot_t*));
+    if (snapshots == NULL)
+        errno_abort ("Allocate view");
+
+    // lock every shard's mutex, always in the same order, so that
+    // the snapshots are one consistent picture of all the shards,
+    // and apply the commands still queued for each
+    total = 0;
+    for (i = 0; i < shard_count; i++){
+        shard_lock(&shards[i], LOCK_VIEW);
+        shard_drain(&shards[i]);
+        snapshots[i] = shard_snapshot(&shards[i]);
+        total += snapshots[i]->count;
+    }
+
+    // get current time. needed when time changes
+    now = alarm_now();
+    for (i = shard_count - 1; i >= 0; i--)
+        shard_unlock(&shards[i]);
+    wall = json ? alarm_wall() : 0;
+
+    // a type nobody has used has no alarms
+    filter = parse_type(parse, 0);
+    if ((parse->type != NULL || parse->type_id >= 0) && filter < 0)
+        total = 0;
+
+    // the snapshots are not in order, so gather all the shards
+    // into one array and sort it by time
+    count = 0;
+    rows = (view_row_t**)malloc((total + 1) * sizeof(view_row_t*));
+    if (rows == NULL)
+        errno_abort ("Allocate view");
+    for (i = 0; i < shard_count && total != 0; i++)
+        for (j = 0; j < snapshots[i]->count; j++)
+            if (filter < 0 || snapshots[i]->rows[j].type == filter)
+                rows[count++] = &snapshots[i]->rows[j];
+    qsort(rows, count, sizeof(view_row_t*), compare_time);
+    for (i = 0; i < count; i++){
+        row = rows[i];
+        time_left = row->time > now ? row->time - now : 0;
+        if (length > sizeof(output) - VIEW_LINE){
+            view_write(reply, output, length);
+            length = 0;
+        }
+        if (json){
+            json_begin(&out, output + length, "view", now, wall);
+            json_fields(&out, row->alarm_id, row->type, row->duration,
+                row->time, row->message);
+            json_uint(&out, "left_ns", time_left);
+            length += json_end(&out);
+            continue;
+        }
+        length += snprintf(output + length, sizeof(output) - length,
+        "Alarm(%d): T%s %s time left: %s seconds. Message: %s\n",
+        row->alarm_id, type_name(row->type),
+        duration_format(duration, sizeof(duration), row->duration),
+        duration_format(left, sizeof(left), time_left), row->message);
+    }
+    if (length != 0)
+        view_write(reply, output, length);
+    if (count == 0)
+        reply_text(reply, none, sizeof(none) - 1);
+
+    free(rows);
+    for (i = 0; i < shard_count; i++)
+        snapshot_release(snapshots[i]);
+    free(snapshots);
+}
+
+/*
+ * Replay mode (-f file). The file is mapped privately and read
+ * in place: each newline is overwritten with a NUL and the line
+ * handed straight to parse_line, so nothing is copied. Nothing
+ * points into the mapping afterwards (types are interned), so it
+ * is unmapped once the file has been replayed.
+ *
+ * Commands are collected per shard and applied REPLAY_BATCH at a
+ * time under a single acquisition of the shard mutex, bypassing
+ * the command queue. There is no prompt and no per-command echo;
+ * errors are still reported, with the file name and line number.
+ */
+#define REPLAY_BATCH    512
+
+typedef struct replay_tag {
+    command_t           commands[REPLAY_BATCH];
+    int                 count;
+} replay_t;
+
+static void replay_flush (replay_t *replay, shard_t *shard){
+    int i;
+
+    if (replay->count == 0)
+        return;
+    shard_lock(shard, LOCK_REPLAY);
+    for (i = 0; i < replay->count; i++)
+        apply_command(shard, &replay->commands[i]);
+    alarm_reschedule(shard);
+    shard_unlock(shard);
+    replay->count = 0;
+}
+
+static void replay_add (replay_t *replays, shard_t *shard,
+    command_op_t op, int alarm_id, alarm_t *alarm){
+    replay_t *replay = &replays[shard - shards];
+    command_t *command = &replay->commands[replay->count++];
+
+    command->op = op;
+    command->alarm_id = alarm_id;
+    command->alarm = alarm;
+    command->echo = 0;
+    if (replay->count == REPLAY_BATCH)
+        replay_flush(replay, shard);
+}
+
+static void replay_file (const char *path){
+    replay_t *replays;
+    struct stat info;
+    parse_t parse;
+    char *map, *line, *end, *newline, *last = NULL;
+    int fd, number, type, i;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &info) < 0)
+        errno_abort ("Open replay file");
+    if (info.st_size == 0){
+        close(fd);
+        return;
+    }
+    map = (char*)mmap(NULL, info.st_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+        errno_abort ("Map replay file");
+    close(fd);
+    madvise(map, info.st_size, MADV_SEQUENTIAL);
+    replays = (replay_t*)calloc(shard_count, sizeof(replay_t));
+    if (replays == NULL)
+        errno_abort ("Allocate replay batches");
+
+    end = map + info.st_size;
+    for (line = map, number = 1; line < end; line = newline + 1, number++){
+        newline = (char*)memchr(line, '\n', end - line);
+        if (newline != NULL){
+            *newline = '\0';
+        } else {
+            // the last line has no newline to overwrite, and there
+            // may be no room after it in the mapping, so copy it
+            newline = end;
+            line = last = strndup(line, end - line);
+            if (line == NULL)
+                errno_abort ("Copy last line");
+        }
+        switch (parse_line(line, &parse)){
+        case PARSE_EMPTY:
+            break;
+        case PARSE_START:
+        case PARSE_CHANGE:
+            if ((type = type_intern(parse.type)) < 0){
+                fprintf(stderr, "%s:%d: Too many alarm types\n", path, number);
+                break;
+            }
+            replay_add(replays, shard_of(parse.alarm_id),
+                parse.kind == PARSE_START ? CMD_START : CMD_CHANGE,
+                parse.alarm_id, alarm_create(parse.alarm_id, type,
+                    parse.duration, parse.message));
+            break;
+        case PARSE_CANCEL:
+            replay_add(replays, shard_of(parse.alarm_id), CMD_CANCEL,
+                parse.alarm_id, NULL);
+            break;
+        case PARSE_BEGIN:
+        case PARSE_COMMIT:
+            // replayed commands are applied in batches anyway
+            break;
+        case PARSE_VIEW:
+            // everything before the View must show up in it
+            for (i = 0; i < shard_count; i++)
+                replay_flush(&replays[i], &shards[i]);
+            View_Alarms(&parse, NULL);
+            break;
+        case PARSE_STATS:
+            echo_stats(NULL);
+            break;
+        case PARSE_LEGACY:
+            replay_add(replays, legacy_shard(), CMD_START, -1,
+                alarm_create(-1, 0, parse.duration, parse.message));
+            break;
+        case PARSE_BAD:
+            fprintf(stderr, "%s:%d: Bad command\n", path, number);
+            break;
+        }
+    }
+    for (i = 0; i < shard_count; i++)
+        replay_flush(&replays[i], &shards[i]);
+    free(replays);
+    free(last);
+    munmap(map, info.st_size);
+}
+
+/*
+ * A batch (Begin_Batch() ... Commit_Batch()) collects commands
+ * without running them. Commit_Batch applies them all at once:
+ * every shard the batch touches is locked, in shard order as in
+ * View_Alarms, for the whole of it, so nothing else sees part of
+ * a batch, and each shard is locked only once however many
+ * commands it gets.
+ *
+ * Within each shard the commands are applied in order of
+ * deadline, so the alarms go into the store in ascending order:
+ * each heap insertion stops sifting at once, and the wheel fills
+ * one slot at a time. Commands naming the same alarm_id must
+ * still run in the order given, so they are kept together and
+ * sorted by the deadline of the first of them.
+ */
+typedef struct batch_entry_tag {
+    command_t           command;
+    int                 shard;
+    int                 sequence;   /* position in the batch */
+    uint64_t            key;        /* deadline to sort by */
+} batch_entry_t;
+
+typedef struct batch_tag {
+    batch_entry_t       *entries;
+    int                 count;
+    int                 size;
+} batch_t;
+
+static batch_t *batch_begin (void){
+    batch_t *batch = (batch_t*)calloc(1, sizeof(batch_t));
+
+    if (batch == NULL)
+        errno_abort ("Allocate batch");
+    return batch;
+}
+
+static void batch_add (batch_t *batch, shard_t *shard, command_op_t op,
+    int alarm_id, alarm_t *alarm){
+    batch_entry_t *entry;
+
+    if (batch->count == batch->size){
+        batch->size = batch->size == 0 ? 64 : batch->size * 2;
+        batch->entries = (batch_entry_t*)realloc(batch->entries,
+            batch->size * sizeof(batch_entry_t));
+        if (batch->entries == NULL)
+            errno_abort ("Grow batch");
+    }
+    entry = &batch->entries[batch->count];
+    entry->command.op = op;
+    entry->command.alarm_id = alarm_id;
+    entry->command.alarm = alarm;
+    entry->command.echo = 0;
+    entry->shard = shard - shards;
+    entry->sequence = batch->count++;
+    entry->key = alarm != NULL ? alarm->time : 0;
+}
+
+// Throws a batch away without applying it, with the alarms it carries.
+static void batch_discard (void *arg){
+    batch_t *batch = (batch_t*)arg;
+    int i;
+
+    for (i = 0; i < batch->count; i++)
+        if (batch->entries[i].command.alarm != NULL)
+            alarm_free(batch->entries[i].command.alarm);
+    free(batch->entries);
+    free(batch);
+}
+
+// qsort comparator: group the commands for each alarm_id, in order
+static int compare_id (const void *a, const void *b){
+    const batch_entry_t *x = (const batch_entry_t*)a;
+    const batch_entry_t *y = (const batch_entry_t*)b;
+
+    if (x->command.alarm_id != y->command.alarm_id)
+        return x->command.alarm_id < y->command.alarm_id ? -1 : 1;
+    return x->sequence - y->sequence;
+}
+
+// qsort comparator: order by shard, then deadline, then position
+static int compare_key (const void *a, const void *b){
+    const batch_entry_t *x = (const batch_entry_t*)a;
+    const batch_entry_t *y = (const batch_entry_t*)b;
+
+    if (x->shard != y->shard)
+        return x->shard - y->shard;
+    if (x->key != y->key)
+        return x->key < y->key ? -1 : 1;
+    return x->sequence - y->sequence;
+}
+
+// Applies a batch and frees it. Returns the number of commands.
+static int batch_commit (batch_t *batch){
+    batch_entry_t *entries = batch->entries;
+    int count = batch->count, i, j;
+
+    // every command for an alarm_id sorts by the first one's
+    // deadline; legacy alarms (-1) are all independent
+    qsort(entries, count, sizeof(batch_entry_t), compare_id);
+    for (i = 0; i < count; i = j){
+        j = i + 1;
+        if (entries[i].command.alarm_id == -1)
+            continue;
+        for (; j < count && entries[j].command.alarm_id == entries[i].command.alarm_id; j++)
+            entries[j].key = entries[i].key;
+    }
+    qsort(entries, count, sizeof(batch_entry_t), compare_key);
+
+    // lock each shard once, in order, and apply whatever was
+    // queued for it before the batch
+    for (i = 0; i < count; i++){
+        if (i > 0 && entries[i].shard == entries[i - 1].shard)
+            continue;
+        shard_lock(&shards[entries[i].shard], LOCK_BATCH);
+        shard_drain(&shards[entries[i].shard]);
+    }
+    for (i = 0; i < count; i++)
+        apply_command(&shards[entries[i].shard], &entries[i].command);
+    for (i = count - 1; i >= 0; i--){
+        if (i > 0 && entries[i].shard == entries[i - 1].shard)
+            continue;
+        alarm_reschedule(&shards[entries[i].shard]);
+        shard_unlock(&shards[entries[i].shard]);
+    }
+
+    batch->count = 0;   // the alarms now belong to the stores
+    batch_discard(batch);
+    return count;
+}
+
+// Adds one command to an open batch. Returns 0 for a command that
+// cannot go in a batch, or a type there is no room for.
+static int batch_command (batch_t *batch, parse_t *parse){
+    int type;
+
+    switch (parse->kind){
+    case PARSE_START:
+    case PARSE_CHANGE:
+        if ((type = parse_type(parse, 1)) < 0)
+            return 0;
+        batch_add(batch, shard_of(parse->alarm_id),
+            parse->kind == PARSE_START ? CMD_START : CMD_CHANGE,
+            parse->alarm_id, alarm_create(parse->alarm_id, type,
+            parse->duration, parse->message));
+        return 1;
+    case PARSE_CANCEL:
+        batch_add(batch, shard_of(parse->alarm_id), CMD_CANCEL,
+            parse->alarm_id, NULL);
+        return 1;
+    case PARSE_LEGACY:
+        batch_add(batch, legacy_shard(), CMD_START, -1,
+            alarm_create(-1, 0, parse->duration, parse->message));
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// Runs one parsed command, from a text line or a binary frame.
+// The echo of later commands reuses the fields of earlier ones,
+// so keep copies
+static void run_command (parse_t *parse){
+    static char type[65] = "";
+    static char duration_text[32] = ""; // duration as typed, e.g. 10, 1.5, 250ms
+    static char message[64] = "";
+    static batch_t *batch = NULL; // open batch, if any
+    alarm_t *alarm;
+    int type_id;
+
+    // a binary frame carries no text, so make some for the echo
+    if (parse->kind == PARSE_START || parse->kind == PARSE_CHANGE){
+        if (parse->type != NULL)
+            strcpy(type, parse->type);
+        else
+            snprintf(type, sizeof(type), "%d", parse->type_id);
+    }
+    if (parse->kind == PARSE_START || parse->kind == PARSE_CHANGE
+        || parse->kind == PARSE_LEGACY){
+        if (parse->duration_text != NULL)
+            strcpy(duration_text, parse->duration_text);
+        else
+            duration_format(duration_text, sizeof(duration_text),
+                parse->duration);
+        strcpy(message, parse->message);
+    }
+
+    // inside a batch, commands are only collected
+    if (batch != NULL && parse->kind != PARSE_EMPTY
+        && parse->kind != PARSE_COMMIT){
+        if (!batch_command(batch, parse))
+            echo_printf("Bad command\n");
+        return;
+    }
+
+    switch (parse->kind){
+    case PARSE_EMPTY:
+        break;
+
+    case PARSE_BEGIN:
+        echo_printf("Beginning batch\n");
+        batch = batch_begin();
+        break;
+
+    case PARSE_COMMIT:
+        if (batch == NULL){
+            echo_printf("Bad command\n");
+            break;
+        }
+        echo_printf("Batch of %d commands committed at %d\n",
+            batch_commit(batch), (int)time(NULL));
+        batch = NULL;
+        break;
+
+    case PARSE_START:
+    case PARSE_CHANGE:
+        if ((type_id = parse_type(parse, 1)) < 0){
+            echo_printf("Too many alarm types\n");
+            break;
+        }
+        if (parse->kind == PARSE_START){
+            Start_Alarm(parse->alarm_id, type_id, parse->duration, message);
+            break;
+        }
+
+        // Change Alarm function call
+        Change_Alarm(parse->alarm_id, type_id, parse->duration, message);
+        echo_printf("Alarm(%d) Changed at %d: T%s %s %s\n",
+        parse->alarm_id, (int)time(NULL), type, duration_text, message);
+        break;
+
+        // Cancel Alarm function call
+    case PARSE_CANCEL:
+        Cancel_Alarm(parse->alarm_id);
+        echo_printf("Alarm(%d) Cancelled at %d: T%s %s %s\n",
+        parse->alarm_id, (int)time(NULL), type, duration_text, message);
+        break;
+
+        // View Alarms function call
+    case PARSE_VIEW:
+        View_Alarms(parse, NULL);
+        break;
+
+    case PARSE_STATS:
+        echo_stats(NULL);
+        break;
+
+    case PARSE_BAD:
+        echo_printf("Bad command\n");
+        //fprintf (stderr, "Bad command\n");
+        break;
+
+    /*
+     * A duration and a message of up to 63 characters,
+     * separated from the duration by whitespace.
+     */
+    case PARSE_LEGACY:
+        // legacy alarms have no id or type of their own
+        alarm = alarm_create (-1, 0, parse->duration, message);
+
+        /*
+         * Queue the new alarm for the shard, which inserts it
+         * into the store, ordered by expiration time.
+         */
+        shard_submit (legacy_shard (), CMD_START, -1, alarm, 1);
+        break;
+    }
+}
+
+// Runs one command from a socket client (see alarm_server.h) on
+// the server thread. The same as run_command, but the client gets
+// an acknowledgement instead of the echo, and the text of
+// View_Alarms and Stats() comes back to it ahead of that. A
+// connection's open batch is kept in its context. Returns 0 for a
+// bad command.
+static int serve_command (parse_t *parse, void **context){
+    batch_t *batch = (batch_t*)*context;
+    int type;
+
+    if (batch != NULL){
+        if (parse->kind != PARSE_COMMIT)
+            return batch_command(batch, parse);
+        batch_commit(batch);
+        *context = NULL;
+        return 1;
+    }
+
+    switch (parse->kind){
+    case PARSE_BEGIN:
+        *context = batch_begin();
+        return 1;
+    case PARSE_START:
+    case PARSE_CHANGE:
+        if ((type = parse_type(parse, 1)) < 0)
+            return 0;
+        shard_submit(shard_of(parse->alarm_id),
+            parse->kind == PARSE_START ? CMD_START : CMD_CHANGE,
+            parse->alarm_id, alarm_create(parse->alarm_id, type,
+            parse->duration, parse->message), 0);
+        return 1;
+    case PARSE_CANCEL:
+        shard_submit(shard_of(parse->alarm_id), CMD_CANCEL,
+            parse->alarm_id, NULL, 0);
+        return 1;
+    case PARSE_VIEW:
+        View_Alarms(parse, server_reply);
+        return 1;
+    case PARSE_STATS:
+        echo_stats(server_reply);
+        return 1;
+    case PARSE_LEGACY:
+        shard_submit(legacy_shard(), CMD_START, -1,
+            alarm_create(-1, 0, parse->duration, parse->message), 0);
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Read binary frames (see alarm_binary.h) from "fd" until end of
+ * file, running each command as it is decoded. There is no
+ * prompt, but the commands are echoed just as text commands are.
+ */
+static void read_binary (int fd){
+    static unsigned char buffer[64 * 1024];
+    binary_command_t command;
+    size_t have = 0, offset;
+    ssize_t got;
+    int used;
+
+    while ((got = read(fd, buffer + have, sizeof(buffer) - have)) != 0){
+        if (got < 0){
+            if (errno == EINTR)
+                continue;
+            errno_abort ("Read binary commands");
+        }
+        have += got;
+        offset = 0;
+        while ((used = binary_decode(buffer + offset, have - offset, &command)) > 0){
+            run_command(&command.parse);
+            offset += used;
+        }
+        memmove(buffer, buffer + offset, have - offset);
+        have -= offset;
+    }
+    if (have != 0)
+        fprintf(stderr, "Incomplete binary command at end of input\n");
+}
+
+#ifdef __linux__
+/*
+ * Input for the single-threaded loops: "have" bytes of stdin not
+ * yet run as commands.
+ */
+static char loop_input[64 * 1024];
+static size_t loop_have = 0;
+
+// System calls the loops make for input, timers and output
+static unsigned long loop_syscalls = 0;
+
+/*
+ * Output of the epoll loop (-1), which takes the place of the
+ * sink: there is no writer thread, and the loop write()s what has
+ * collected here to stdout itself, once each time round or when it
+ * fills up. stdout is left blocking, so a slow reader holds up the
+ * loop; that is "-o block", the only policy the epoll loop has.
+ */
+#define LOOP_OUTPUT     (256 * 1024)
+
+static char loop_output[LOOP_OUTPUT];
+static size_t loop_pending = 0;
+
+static void loop_flush (void){
+    size_t done = 0;
+    ssize_t written;
+
+    while (done < loop_pending){
+        loop_syscalls++;
+        written = write(STDOUT_FILENO, loop_output + done, loop_pending - done);
+        if (written < 0){
+            if (errno == EINTR)
+                continue;
+            errno_abort ("Write alarm output");
+        }
+        done += written;
+    }
+    loop_pending = 0;
+}
+
+// Takes the place of sink_write. Nothing is dropped, so "messages"
+// does not matter: a full buffer is written out first
+static void loop_write (const char *text, size_t length, int messages){
+    (void)messages;
+    if (loop_pending + length > sizeof(loop_output))
+        loop_flush();
+    memcpy(loop_output + loop_pending, text, length);
+    loop_pending += length;
+}
+
+/*
+ * "got" more bytes of stdin have been read into loop_input (0 at
+ * end of file). Run every complete command there: text lines, or
+ * binary frames if "binary" is set. At end of file a last line
+ * without a newline still counts, as it does for fgets. Returns 0
+ * at end of file.
+ */
+static int loop_parse (size_t got, int binary){
+    binary_command_t command;
+    parse_t parse;
+    size_t offset = 0;
+    char *newline;
+    int used;
+
+    loop_have += got;
+    if (binary){
+        while ((used = binary_decode((unsigned char*)loop_input + offset,
+            loop_have - offset, &command)) > 0){
+            run_command(&command.parse);
+            offset += used;
+        }
+        if (got == 0 && loop_have != offset)
+            fprintf(stderr, "Incomplete binary command at end of input\n");
+    } else {
+        while (offset < loop_have){
+            newline = memchr(loop_input + offset, '\n', loop_have - offset);
+            if (newline == NULL){
+                // keep a partial line for the next read, unless
+                // stdin has ended or the line fills the buffer
+                if (got != 0 && loop_have - offset < sizeof(loop_input))
+                    break;
+                newline = loop_input + (loop_have < sizeof(loop_input)
+                    ? loop_have : loop_have - 1);
+            }
+            *newline = '\0';
+            parse_line(loop_input + offset, &parse);
+            run_command(&parse);
+            if (!json)
+                echo_printf("alarm> ");
+            offset = newline - loop_input + 1;
+            if (offset > loop_have)
+                offset = loop_have;
+        }
+    }
+    memmove(loop_input, loop_input + offset, loop_have - offset);
+    loop_have -= offset;
+    return got != 0;
+}
+
+/*
+ * Deliver every alarm that is due in any shard, and return the
+ * earliest time a store needs attention again (0 if never).
+ */
+static uint64_t loop_expire (void){
+    uint64_t when = 0, next;
+    alarm_t *batch;
+    int i;
+
+    for (i = 0; i < shard_count; i++){
+        batch = store_expire(&shards[i].store, alarm_now());
+        if (batch != NULL){
+            batch_detach(&shards[i], batch);
+            batch_deliver(batch);
+        }
+        if (store_next(&shards[i].store, &next) && (when == 0 || next < when))
+            when = next;
+    }
+    return when;
+}
+
+/*
+ * The single-threaded mode (-1). Delivers due alarms, arms the
+ * timerfd for the earliest deadline left in any shard, and waits
+ * in epoll for that or for stdin, until stdin ends. A regular
+ * file cannot go in epoll; it is always ready, so it is read
+ * between polls that do not wait.
+ */
+static void event_loop (int binary){
+    struct epoll_event event, events[2];
+    struct itimerspec spec;
+    uint64_t when, armed = 0, expirations;
+    ssize_t got;
+    int epollfd, timerfd, pollable, count, i, open = 1;
+
+    timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerfd < 0)
+        errno_abort ("Create timerfd");
+    epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollfd < 0)
+        errno_abort ("Create epoll");
+    event.events = EPOLLIN;
+    event.data.fd = timerfd;
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, timerfd, &event) < 0)
+        errno_abort ("Add timerfd to epoll");
+    event.data.fd = STDIN_FILENO;
+    pollable = epoll_ctl(epollfd, EPOLL_CTL_ADD, STDIN_FILENO, &event) == 0;
+    if (!pollable && errno != EPERM)
+        errno_abort ("Add stdin to epoll");
+    if (pollable && fcntl(STDIN_FILENO, F_SETFL,
+        fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK) < 0)
+        errno_abort ("Make stdin non-blocking");
+
+    if (!binary && !json)
+        echo_printf("alarm> ");
+    while (open){
+        when = loop_expire();
+        if (when != armed){
+            spec.it_interval.tv_sec = 0;
+            spec.it_interval.tv_nsec = 0;
+            spec.it_value.tv_sec = when / NSEC_PER_SEC;     // 0 disarms
+            spec.it_value.tv_nsec = when % NSEC_PER_SEC;
+            loop_syscalls++;
+            if (timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &spec, NULL) < 0)
+                errno_abort ("Arm timerfd");
+            armed = when;
+        }
+
+        loop_flush();
+        count = 0;
+        if (pollable){
+            loop_syscalls++;
+            count = epoll_wait(epollfd, events, 2, -1);
+            if (count < 0 && errno != EINTR)
+                errno_abort ("Wait for events");
+        }
+        for (i = 0; i < count; i++){
+            if (events[i].data.fd == timerfd){
+                loop_syscalls++;
+                if (read(timerfd, &expirations, sizeof(expirations)) < 0
+                    && errno != EAGAIN)
+                    errno_abort ("Read timerfd");
+            }
+        }
+
+        // for a file, read a chunk each time round
+        if (!pollable || count > 1 || (count == 1 && events[0].data.fd != timerfd)){
+            loop_syscalls++;
+            got = read(STDIN_FILENO, loop_input + loop_have,
+                sizeof(loop_input) - loop_have);
+            if (got < 0 && errno != EAGAIN && errno != EINTR)
+                errno_abort ("Read commands");
+            if (got >= 0)
+                open = loop_parse(got, binary);
+        }
+    }
+    loop_flush();
+    close(epollfd);
+    close(timerfd);
+}
+
+/*
+ * The single-threaded mode on io_uring (-1 -u). The same loop as
+ * event_loop, but stdin is read, the deadline timed and the alarm
+ * messages written by requests on one ring (see alarm_uring.h).
+ * Each time round, a single io_uring_enter submits whatever has
+ * changed (a new read, a moved timeout, a write of the messages
+ * delivered so far) and waits for the next completion.
+ *
+ * Messages are collected in one of two buffers while the other is
+ * being written, instead of in loop_output, and the -o policies
+ * apply when both are in use (see uring_output). The
+ * tags say what completed; a timeout's tag also carries its
+ * generation, so a timeout that has been replaced is ignored.
+ */
+#define URING_ENTRIES   64
+#define URING_OUTPUT    (256 * 1024)
+
+enum { TAG_READ = 1, TAG_WRITE, TAG_CANCEL, TAG_TIMEOUT };
+
+static struct uring_loop_tag {
+    int                 reading;    /* a read of stdin is in flight */
+    int                 got;        /* its result, once it completes */
+    int                 got_ready;
+    int                 writing;    /* a write of output[1 - fill] */
+    size_t              written;    /* how much of that is done */
+    int                 fill;       /* output buffer being filled */
+    size_t              length[2];
+    char                output[2][URING_OUTPUT];
+    sink_policy_t       policy;     /* -o */
+    unsigned long       dropped;    /* messages thrown away */
+    unsigned long       unreported; /* dropped, no notice written yet */
+} uloop;
+
+/*
+ * Note what one completion means; the loop acts on it later.
+ * Completes a short write by writing the rest.
+ */
+static void uring_event (uint64_t tag, int result){
+    int other = 1 - uloop.fill;
+
+    switch (tag & 0xff){
+    case TAG_READ:
+        uloop.reading = 0;
+        uloop.got = result;
+        uloop.got_ready = 1;
+        break;
+    case TAG_WRITE:
+        if (result < 0)
+            err_abort (-result, "Write alarm output");
+        uloop.written += result;
+        if (uloop.written < uloop.length[other])
+            uring_write(STDOUT_FILENO, uloop.output[other] + uloop.written,
+                uloop.length[other] - uloop.written, TAG_WRITE);
+        else {
+            uloop.length[other] = 0;
+            uloop.writing = 0;
+        }
+        break;
+    }
+}
+
+// Takes every completion there is, without waiting
+static void uring_reap (void){
+    uint64_t tag;
+    int result;
+
+    while (uring_complete(&tag, &result))
+        uring_event(tag, result);
+}
+
+// Submits and waits for one completion, and takes all there are
+static void uring_wait (void){
+    uring_submit(1);
+    uring_reap();
+}
+
+/*
+ * If the previous write has finished, start writing the buffer
+ * that has been filled, and fill the other one.
+ */
+static void uring_flush (void){
+    if (uloop.writing || uloop.length[uloop.fill] == 0)
+        return;
+    uring_write(STDOUT_FILENO, uloop.output[uloop.fill],
+        uloop.length[uloop.fill], TAG_WRITE);
+    uloop.writing = 1;
+    uloop.written = 0;
+    uloop.fill = 1 - uloop.fill;
+}
+
+/*
+ * Takes the place of sink_write, with the same policies. When the
+ * buffer being filled has no room and the other one is still being
+ * written, "-o block" waits for that write to finish and swaps;
+ * "-o drop" and "-o count" throw the "messages" away instead, and
+ * count keeps a notice of them for when there is room. Text that
+ * holds no messages always waits.
+ */
+static void uring_output (const char *text, size_t length, int messages){
+    char notice[64];
+    int notice_length = 0;
+
+    if (uloop.unreported != 0)
+        notice_length = snprintf(notice, sizeof(notice),
+            "(%lu alarm messages dropped)\n", uloop.unreported);
+    if (uloop.length[uloop.fill] + notice_length + length > URING_OUTPUT){
+        uring_reap();   // the write may be done already
+        if (uloop.writing && uloop.policy != SINK_BLOCK && messages != 0){
+            uloop.dropped += messages;
+            if (uloop.policy == SINK_COUNT)
+                uloop.unreported += messages;
+            return;
+        }
+        while (uloop.writing)
+            uring_wait();
+        uring_flush();
+    }
+    if (notice_length != 0){
+        memcpy(uloop.output[uloop.fill] + uloop.length[uloop.fill],
+            notice, notice_length);
+        uloop.length[uloop.fill] += notice_length;
+        uloop.unreported = 0;
+    }
+    memcpy(uloop.output[uloop.fill] + uloop.length[uloop.fill], text, length);
+    uloop.length[uloop.fill] += length;
+}
+
+static void uring_loop (int binary, sink_policy_t policy){
+    uint64_t when, armed = 0, generation = 0;
+    int open = 1;
+
+    if (!uring_init(URING_ENTRIES)){
+        fprintf(stderr, "io_uring is not available; using epoll\n");
+        event_loop(binary);
+        return;
+    }
+    loop_flush();   // whatever a replayed file (-f) printed
+    uloop.policy = policy;
+    deliver_write = uring_output;
+
+    if (!binary && !json)
+        echo_printf("alarm> ");
+    while (open){
+        when = loop_expire();
+        if (when != armed){
+            if (armed != 0)
+                uring_cancel(TAG_TIMEOUT | generation << 8, TAG_CANCEL);
+            generation++;
+            if (when != 0)
+                uring_timeout(when, TAG_TIMEOUT | generation << 8);
+            armed = when;
+        }
+        uring_flush();
+
+        /*
+         * Output that waits for a write (uring_output) can take the
+         * read's completion too, so a read may be done before we get
+         * here. Its bytes sit at loop_input + loop_have until
+         * loop_parse takes them: parse them before reading again.
+         */
+        if (uloop.got_ready){
+            uloop.got_ready = 0;
+            if (uloop.got < 0 && uloop.got != -EAGAIN && uloop.got != -EINTR)
+                err_abort (-uloop.got, "Read commands");
+            if (uloop.got >= 0)
+                open = loop_parse(uloop.got, binary);
+            continue;
+        }
+        if (!uloop.reading){
+            uring_read(STDIN_FILENO, loop_input + loop_have,
+                sizeof(loop_input) - loop_have, TAG_READ);
+            uloop.reading = 1;
+        }
+        uring_wait();
+    }
+
+    // let the last messages out before exiting
+    uring_flush();
+    while (uloop.writing || uloop.length[uloop.fill] != 0){
+        uring_wait();
+        uring_flush();
+    }
+    if (uloop.dropped != 0)
+        fprintf(stderr, "%lu alarm messages dropped\n", uloop.dropped);
+}
+
+/*
+ * Report the system calls the loop made per 1000 alarms
+ * delivered. Registered with atexit for -1; the loops have written
+ * all their output by the time they return.
+ */
+static void loop_report (void){
+    unsigned long delivered = 0, calls;
+    int i;
+
+    for (i = 0; i < shard_count; i++)
+        delivered += shards[i].delivered;
+    calls = loop_syscalls + uring_enters;
+    fprintf(stderr, "%lu system calls for input, timers and output", calls);
+    if (delivered != 0)
+        fprintf(stderr, " (%.1f per 1000 alarms)",
+            calls * 1000.0 / delivered);
+    fprintf(stderr, "\n");
+}
+#endif
+
+// Below is the main function/thread
+int main (int argc, char *argv[])
+{
+    int status;
+    char sline[128];
+    parse_t parse; // fields point into sline
+    shard_t *shard;
+    const char *store_name = NULL;
+    const char *engine_name = NULL;
+    const char *replay_name = NULL;
+    const char *sink_name = NULL;
+    sink_policy_t policy;
+    const char *socket_name = NULL;
+    int binary = 0;
+    int uring = 0;
+    int option, i;
+
+    /*
+     * -s <backend> selects the alarm store, -e <engine> the way
+     * the alarm threads wait for the earliest alarm, and
+     * -n <shards> the number of shards. -f <file> replays the
+     * commands in a file before reading any from stdin, and
+     * -o <policy> says what to do with alarm messages the output
+     * sink has no room for. -b reads binary commands from stdin
+     * (and the socket) instead of text. -l <path> also accepts
+     * commands from clients of a Unix domain socket at "path".
+     * -1 runs everything on one thread (see event_loop); the
+     * socket server is a thread of its own, so it cannot be used
+     * with -1, and neither can -e. -u makes the -1 loop use
+     * io_uring (see uring_loop). -j writes events as JSON lines.
+     * -w <workers> caps the display workers that format expired
+     * alarms, one per type (DISPLAY_WORKERS by default); -w 0 has
+     * the alarm threads deliver their own batches instead. Workers
+     * need threads, so -1 delivers inline and takes only -w 0.
+     */
+    while ((option = getopt (argc, argv, "s:e:n:f:o:bl:1ujw:")) != -1) {
+        switch (option) {
+        case 's':
+            store_name = optarg;
+            break;
+        case 'e':
+            engine_name = optarg;
+            break;
+        case 'f':
+            replay_name = optarg;
+            break;
+        case 'o':
+            sink_name = optarg;
+            break;
+        case 'b':
+            binary = 1;
+            break;
+        case 'l':
+            socket_name = optarg;
+            break;
+        case 'j':
+            json = 1;
+            break;
+        case 'w':
+            display_workers = atoi (optarg);
+            if (display_workers >= 0)
+                break;
+            fprintf (stderr, "-w needs a number of workers\n");
+            exit (1);
+#ifdef __linux__
+        case '1':
+            single = 1;
+            break;
+        case 'u':
+            uring = 1;
+            break;
+#endif
+        case 'n':
+            shard_count = atoi (optarg);
+            if (shard_count >= 1)
+                break;
+            /* fall through */
+        default:
+            fprintf (stderr,
+                "usage: %s [-s store] [-e engine] [-n shards]"
+                " [-f file] [-o policy] [-b] [-j] [-w workers]"
+                " [-l socket | -1 [-u]]\n", argv[0]);
+            fprintf (stderr, "stores:");
+            for (i = 0; store_backends[i] != NULL; i++)
+                fprintf (stderr, " %s", store_backends[i]->name);
+            fprintf (stderr, "\nengines:");
+            for (i = 0; engine_backends[i] != NULL; i++)
+                fprintf (stderr, " %s", engine_backends[i]->name);
+            fprintf (stderr, "\npolicies:");
+            for (i = 0; sink_policies[i] != NULL; i++)
+                fprintf (stderr, " %s", sink_policies[i]);
+            fprintf (stderr, "\n");
+            exit (1);
+        }
+    }
+    if (single && (socket_name != NULL || engine_name != NULL
+        || display_workers > 0)) {
+        fprintf (stderr, "-1 cannot be used with -l, -e or -w\n");
+        exit (1);
+    }
+    if (display_workers < 0)
+        display_workers = single ? 0 : DISPLAY_WORKERS;
+    if (uring && !single) {
+        fprintf (stderr, "-u needs -1\n");
+        exit (1);
+    }
+    if (!sink_policy (sink_name, &policy)) {
+        fprintf (stderr, "Unknown policy \"%s\"\n", sink_name);
+        exit (1);
+    }
+#ifdef __linux__
+    if (single) {
+        if (!uring && policy != SINK_BLOCK) {
+            fprintf (stderr, "-1 without -u always blocks for output\n");
+            exit (1);
+        }
+        deliver_write = loop_write;
+    }
+#endif
+    if (!single)
+        sink_init (STDOUT_FILENO, sink_name);
+    shards = (shard_t*)calloc (shard_count, sizeof (shard_t));
+    if (shards == NULL)
+        errno_abort ("Allocate shards");
+    if (display_workers != 0)
+        display_start (display_workers, shard_count, batch_deliver);
+    for (i = 0; i < shard_count; i++) {
+        shard = &shards[i];
+        lock_init (&shard->lock);
+        index_init (&shard->index);
+        queue_init (&shard->queue);
+        if (!store_init (&shard->store, store_name, alarm_now ())) {
+            fprintf (stderr, "Unknown store \"%s\"\n", store_name);
+            exit (1);
+        }
+        if (single)
+            continue;
+        if (!engine_init (&shard->engine, engine_name)) {
+            fprintf (stderr, "Unknown engine \"%s\"\n", engine_name);
+            exit (1);
+        }
+        status = pthread_create (&shard->thread, NULL, alarm_thread, shard);
+        if (status != 0)
+            err_abort (status, "Create alarm thread");
+    }
+    atexit (batch_report);
+    if (!single)
+        atexit (lock_report);
+    if (display_workers != 0)
+        atexit (display_report);
+#ifdef __linux__
+    if (single)
+        atexit (loop_report);
+#endif
+    if (!single)
+        atexit (sink_close);
+    if (replay_name != NULL)
+        replay_file (replay_name);
+    if (socket_name != NULL)
+        server_start (socket_name, binary, serve_command, batch_discard);
+#ifdef __linux__
+    if (single) {
+        if (uring)
+            uring_loop (binary, policy);
+        else
+            event_loop (binary);
+        exit (0);
+    }
+#endif
+    if (binary) {
+        read_binary (STDIN_FILENO);
+    } else {
+        while (1) {
+            if (!json)
+                echo_printf ("alarm> ");
+            if (fgets (sline, sizeof (sline), stdin) == NULL) break;
+
+            // parse the line in place, dispatching on the command keyword
+            // durations may be fractional or carry a unit (see duration_parse)
+            parse_line(sline, &parse);
+            run_command(&parse);
+        }
+    }
+
+    /*
+     * The socket server carries on after stdin runs out, until
+     * the process is killed.
+     */
+    if (socket_name != NULL)
+        while (1)
+            pause ();
+    exit (0);
+}
@@ -0,0 +1,96 @@
+/*
+ * alarm.c
+ *
+ * Time helpers shared by the alarm program and its stores.
+ */
+#include <ctype.h>
+#include "errors.h"
+#include "alarm.h"
+
+/*
+ * Return the current CLOCK_MONOTONIC time in nanoseconds.
+ */
+uint64_t alarm_now (void)
+{
+    struct timespec now;
+
+    if (clock_gettime (CLOCK_MONOTONIC, &now) < 0)
+        errno_abort ("Read monotonic clock");
+    return (uint64_t)now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+/*
+ * Return the current CLOCK_REALTIME time in nanoseconds, for
+ * output that has to be matched up with other logs.
+ */
+uint64_t alarm_wall (void)
+{
+    struct timespec now;
+
+    if (clock_gettime (CLOCK_REALTIME, &now) < 0)
+        errno_abort ("Read real time clock");
+    return (uint64_t)now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+/*
+ * Parse a duration such as "10", "1.5", "1.5s", "250ms", "20us"
+ * or "500ns" into nanoseconds. A number without a unit is in
+ * seconds. Returns 0 if the text is not a valid duration.
+ */
+int duration_parse (const char *text, uint64_t *duration)
+{
+    uint64_t whole = 0, fraction = 0, scale = 1, unit;
+    int digits = 0;
+
+    while (isdigit ((unsigned char)*text)) {
+        if (whole > UINT64_MAX / 10 / NSEC_PER_SEC)
+            return 0;
+        whole = whole * 10 + (*text++ - '0');
+        digits++;
+    }
+    if (*text == '.') {
+        text++;
+        while (isdigit ((unsigned char)*text)) {
+            if (scale < NSEC_PER_SEC) {
+                fraction = fraction * 10 + (*text - '0');
+                scale *= 10;
+            }
+            text++;
+            digits++;
+        }
+    }
+    if (digits == 0)
+        return 0;
+    if (*text == '\0' || strcmp (text, "s") == 0)
+        unit = NSEC_PER_SEC;
+    else if (strcmp (text, "ms") == 0)
+        unit = NSEC_PER_MSEC;
+    else if (strcmp (text, "us") == 0)
+        unit = NSEC_PER_USEC;
+    else if (strcmp (text, "ns") == 0)
+        unit = 1;
+    else
+        return 0;
+    *duration = whole * unit + fraction * unit / scale;
+    return 1;
+}
+
+/*
+ * Format a duration in seconds, with as many decimal places as it
+ * needs ("10", "1.5", "0.25").
+ */
+char *duration_format (char *buf, size_t size, uint64_t duration)
+{
+    uint64_t fraction = duration % NSEC_PER_SEC;
+    int len;
+
+    len = snprintf (buf, size, "%llu",
+        (unsigned long long)(duration / NSEC_PER_SEC));
+    if (fraction != 0 && len > 0 && (size_t)len < size) {
+        len += snprintf (buf + len, size - len, ".%09llu",
+            (unsigned long long)fraction);
+        while (len > 0 && (size_t)len < size && buf[len - 1] == '0')
+            buf[--len] = '\0';
+    }
+    return buf;
+}
@@ -0,0 +1,46 @@
+#ifndef __alarm_h
+#define __alarm_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Alarm deadlines are absolute CLOCK_MONOTONIC times in
+ * nanoseconds, so they are not quantised to whole seconds and do
+ * not move when the wall clock is set. Durations are nanoseconds
+ * as well.
+ */
+#define NSEC_PER_SEC    1000000000ULL
+#define NSEC_PER_MSEC   1000000ULL
+#define NSEC_PER_USEC   1000ULL
+
+/*
+ * The "alarm" structure is shared by the main program and the
+ * alarm store. The "link" and "prev" fields chain the alarm into
+ * whichever store list currently holds it, and "bucket" points
+ * at the head of that list, so that an alarm can be unlinked in
+ * constant time without searching for it. The heap store uses
+ * "heap_index" instead, to find the alarm's slot in its array,
+ * and the skip list store "node", for the node that stands for
+ * the alarm in the list.
+ */
+typedef struct alarm_tag {
+    struct alarm_tag    *link;      /* next alarm in store list */
+    struct alarm_tag    *prev;      /* previous alarm in store list */
+    struct alarm_tag    **bucket;   /* head of the list holding us */
+    int                 heap_index; /* slot in the heap store */
+    void                *node;      /* node in the skip list store */
+    int                 alarm_id;   /* unique alarm ID to identify and edit */
+    uint16_t            type;       /* interned type (see alarm_type.h) */
+    uint64_t            duration;   /* requested duration (ns) */
+    uint64_t            time;       /* CLOCK_MONOTONIC deadline (ns) */
+    char                message[64];
+} alarm_t;
+
+extern uint64_t alarm_now (void);
+extern uint64_t alarm_wall (void);
+extern int duration_parse (const char *text, uint64_t *duration);
+extern char *duration_format (char *buf, size_t size, uint64_t duration);
+
+#endif
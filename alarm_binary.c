@@ -0,0 +1,170 @@
+/*
+ * alarm_binary.c
+ *
+ * Binary command framing. See alarm_binary.h.
+ */
+#include <string.h>
+#include "alarm_binary.h"
+
+static uint64_t get_le (const unsigned char *data, int size)
+{
+    uint64_t value = 0;
+
+    while (size-- > 0)
+        value = value << 8 | data[size];
+    return value;
+}
+
+static void put_le (unsigned char *data, int size, uint64_t value)
+{
+    int i;
+
+    for (i = 0; i < size; i++, value >>= 8)
+        data[i] = (unsigned char)value;
+}
+
+int binary_type (const char *type, unsigned int *id)
+{
+    unsigned long value = 0;
+    const char *digit;
+
+    if (*type == '\0' || (type[0] == '0' && type[1] != '\0'))
+        return 0;
+    for (digit = type; *digit != '\0'; digit++) {
+        if (*digit < '0' || *digit > '9')
+            return 0;
+        value = value * 10 + (*digit - '0');
+        if (value > 0xffff)
+            return 0;
+    }
+    *id = (unsigned int)value;
+    return 1;
+}
+
+/*
+ * Decode the frame at the start of "data". Returns the length of
+ * the frame, or 0 if "length" bytes do not hold all of it yet. A
+ * frame with an unknown opcode decodes as PARSE_BAD; its length
+ * is still known, so the caller can skip it.
+ */
+int binary_decode (
+    const unsigned char *data, size_t length, binary_command_t *command)
+{
+    parse_t *parse = &command->parse;
+    size_t message_length;
+
+    if (length < BINARY_HEADER)
+        return 0;
+    message_length = data[1];
+    if (length < BINARY_HEADER + message_length)
+        return 0;
+    parse->alarm_id = (int32_t)get_le (data + 4, 4);
+    parse->type = NULL;
+    parse->type_id = (int)get_le (data + 2, 2);
+    parse->duration = get_le (data + 8, 8);
+    parse->duration_text = NULL;
+    if (message_length > PARSE_MESSAGE)
+        message_length = PARSE_MESSAGE;
+    memcpy (command->message, data + BINARY_HEADER, message_length);
+    command->message[message_length] = '\0';
+    parse->message = command->message;
+
+    switch (data[0]) {
+    case BINARY_START:
+        parse->kind = PARSE_START;
+        break;
+    case BINARY_CHANGE:
+        parse->kind = PARSE_CHANGE;
+        break;
+    case BINARY_CANCEL:
+        parse->kind = PARSE_CANCEL;
+        break;
+    case BINARY_VIEW:
+        parse->kind = PARSE_VIEW;
+        break;
+    case BINARY_VIEW_TYPE:
+        parse->kind = PARSE_VIEW;
+        break;
+    case BINARY_LEGACY:
+        parse->kind = PARSE_LEGACY;
+        break;
+    case BINARY_BEGIN:
+        parse->kind = PARSE_BEGIN;
+        break;
+    case BINARY_COMMIT:
+        parse->kind = PARSE_COMMIT;
+        break;
+    case BINARY_STATS:
+        parse->kind = PARSE_STATS;
+        break;
+    default:
+        parse->kind = PARSE_BAD;
+        break;
+    }
+
+    // only Start, Change and View_Alarms(T<type>) have a type
+    if (parse->kind != PARSE_START && parse->kind != PARSE_CHANGE
+        && data[0] != BINARY_VIEW_TYPE)
+        parse->type_id = -1;
+
+    /*
+     * The text grammar has no way to write an empty message, or
+     * a negative alarm_id (see alarm_parse.h).
+     */
+    if ((parse->kind == PARSE_START || parse->kind == PARSE_CHANGE
+        || parse->kind == PARSE_CANCEL) && parse->alarm_id < 0)
+        parse->kind = PARSE_BAD;
+    if ((parse->kind == PARSE_START || parse->kind == PARSE_CHANGE
+        || parse->kind == PARSE_LEGACY) && message_length == 0)
+        parse->kind = PARSE_BAD;
+    return BINARY_HEADER + data[1];
+}
+
+/*
+ * Encode a frame into "data", which must have room for
+ * BINARY_MAX bytes. Returns the length of the frame. The fields
+ * "opcode" does not use are written as zero, whatever is passed
+ * for them.
+ */
+size_t binary_encode (unsigned char *data, int opcode, int alarm_id,
+    unsigned int type, uint64_t duration, const char *message)
+{
+    size_t message_length;
+
+    switch (opcode) {
+    case BINARY_START:
+    case BINARY_CHANGE:
+        break;
+    case BINARY_LEGACY:
+        alarm_id = 0;
+        type = 0;
+        break;
+    case BINARY_CANCEL:
+        type = 0;
+        duration = 0;
+        message = NULL;
+        break;
+    case BINARY_VIEW_TYPE:
+        alarm_id = 0;
+        duration = 0;
+        message = NULL;
+        break;
+    default:
+        alarm_id = 0;
+        type = 0;
+        duration = 0;
+        message = NULL;
+        break;
+    }
+    message_length = message != NULL ? strlen (message) : 0;
+    if (message_length > 255)
+        message_length = 255;
+    data[0] = (unsigned char)opcode;
+    data[1] = (unsigned char)message_length;
+    put_le (data + 2, 2, type);
+    put_le (data + 4, 4, (uint32_t)alarm_id);
+    put_le (data + 8, 8, duration);
+    if (message_length != 0)
+        memcpy (data + BINARY_HEADER, message, message_length);
+    return BINARY_HEADER + message_length;
+}
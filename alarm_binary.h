@@ -0,0 +1,64 @@
+#ifndef __alarm_binary_h
+#define __alarm_binary_h
+
+#include "alarm_parse.h"
+
+/*
+ * Binary command framing, an alternative to the text commands
+ * for programs that generate them. Every frame is a 16 byte
+ * header followed by the message bytes; all fields are
+ * little-endian:
+ *
+ *  offset  size
+ *       0     1  opcode (BINARY_START ... BINARY_STATS)
+ *       1     1  message length, in bytes
+ *       2     2  type id: the type that text commands write
+ *                as "T<id>", <id> being the number in decimal
+ *                (see binary_type)
+ *       4     4  alarm_id, signed, but a negative one makes
+ *                Start, Change and Cancel bad commands, as
+ *                in text
+ *       8     8  duration, in nanoseconds
+ *      16     n  message, not NUL terminated
+ *
+ * Fields a command does not use (everything but the opcode for
+ * View_Alarms, Begin_Batch, Commit_Batch and Stats, the type and
+ * alarm_id for a legacy alarm) should be zero and are ignored;
+ * binary_encode always writes them as zero.
+ * BINARY_VIEW_TYPE is View_Alarms(T<type>), and uses the type. A
+ * message longer than PARSE_MESSAGE bytes is cut short, as it is
+ * for text commands.
+ *
+ * binary_type gives the type id of a text type: the type must be
+ * a decimal number from 0 to 65535, as parse_line leaves it, with
+ * no sign or leading zeros, so that formatting the id in decimal
+ * gives back the same type. It returns 0 if the type has no id.
+ *
+ * binary_decode turns a frame into the parse_t that the text
+ * commands parse to, so both kinds of command behave identically,
+ * but fills it in straight from the frame, with nothing formatted
+ * as text: the type is left as a number in type_id, with "type"
+ * NULL, and duration_text is NULL. The message the parse_t points
+ * at lives in the binary_command_t.
+ */
+#define BINARY_HEADER   16
+#define BINARY_MAX      (BINARY_HEADER + 255)
+
+enum {
+    BINARY_START = 1, BINARY_CHANGE, BINARY_CANCEL, BINARY_VIEW,
+    BINARY_LEGACY, BINARY_BEGIN, BINARY_COMMIT, BINARY_VIEW_TYPE,
+    BINARY_STATS
+};
+
+typedef struct binary_command_tag {
+    parse_t             parse;
+    char                message[PARSE_MESSAGE + 1];
+} binary_command_t;
+
+extern int binary_type (const char *type, unsigned int *id);
+extern int binary_decode (
+    const unsigned char *data, size_t length, binary_command_t *command);
+extern size_t binary_encode (unsigned char *data, int opcode, int alarm_id,
+    unsigned int type, uint64_t duration, const char *message);
+
+#endif
@@ -0,0 +1,384 @@
+/*
+ * alarm_display.c
+ *
+ * Per-type display workers. See alarm_display.h.
+ */
+#include <pthread.h>
+#include "errors.h"
+#include "alarm_type.h"
+#include "alarm_display.h"
+
+#define DISPLAY_LINE    64          /* cache line size */
+
+/*
+ * "head" and "tail" count alarms ever taken and pushed, so the
+ * ring holds tail - head alarms starting at head % DISPLAY_RING.
+ * The producer owns "tail". Consumers (the owning worker, and any
+ * thief) read the slots they want and then claim them by moving
+ * "head" past them with a compare-and-swap; the producer does not
+ * reuse a slot until it has seen "head" move past it. Slots are
+ * read and written atomically since a consumer that loses the
+ * race may read one as it is refilled, before throwing it away.
+ *
+ * "overflow" is a stack of the alarms the producer could not fit,
+ * newest first, linked through "link". Once it is in use the
+ * producer keeps pushing there, and a consumer only takes it
+ * (all of it, with an exchange) when the ring is empty, so the
+ * alarms still come out in the order they went in.
+ */
+typedef struct display_ring_tag {
+    uint64_t            tail;
+    alarm_t             *overflow;
+    char                pad1[DISPLAY_LINE - sizeof (uint64_t)
+                            - sizeof (alarm_t*)];
+    uint64_t            head;
+    char                pad2[DISPLAY_LINE - sizeof (uint64_t)];
+    alarm_t             *slots[DISPLAY_RING];
+} display_ring_t;
+
+typedef struct display_worker_tag {
+    pthread_mutex_t     mutex;
+    pthread_cond_t      wake;
+    pthread_t           thread;
+    int                 sleeping;
+    int                 index;
+    display_ring_t      *rings;     /* one per producer */
+    unsigned long       delivered;  /* alarms this worker delivered */
+    unsigned long       stolen;     /* of those, from other workers */
+} display_worker_t;
+
+/*
+ * "workers" has room for worker_max workers, of which the first
+ * worker_count have been started. A worker is set up completely
+ * before worker_count is moved past it, so anyone who reads the
+ * count may use every worker below it. routes[type] is the worker
+ * for that type + 1, or 0 if the type has none yet; route_count
+ * is the number of types routed so far. The mutex is held to add
+ * a route or a worker.
+ */
+static display_worker_t *workers;
+static int worker_max;
+static int worker_count;
+static int producer_count;
+static display_deliver_t display_deliver;
+static char *pushed;                /* [producer][worker] */
+static unsigned long overflowed;    /* alarms pushed on overflow stacks */
+static pthread_mutex_t route_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int routes[TYPE_MAX];
+static int route_count;
+
+/*
+ * Take the whole overflow stack of "ring", in the order it was
+ * pushed, and chain it on at *last. Returns the number taken.
+ */
+static int overflow_take (display_ring_t *ring, alarm_t ***last)
+{
+    alarm_t *alarm, *next, *reversed = NULL;
+    int count = 0;
+
+    if (__atomic_load_n (&ring->overflow, __ATOMIC_RELAXED) == NULL)
+        return 0;
+    alarm = __atomic_exchange_n (&ring->overflow, NULL, __ATOMIC_ACQUIRE);
+    for (; alarm != NULL; alarm = next) {
+        next = alarm->link;
+        alarm->link = reversed;
+        reversed = alarm;
+        count++;
+    }
+    **last = reversed;
+    for (alarm = reversed; alarm != NULL; alarm = alarm->link)
+        *last = &alarm->link;
+    return count;
+}
+
+/*
+ * Take up to DISPLAY_GRAB alarms from "ring" and chain them on
+ * at *last, leaving *last pointing at the new end of the chain.
+ * A thief takes only half of what is there (rounded up), so the
+ * owner is not left to go and steal it back. If the ring is
+ * empty, take its overflow instead. Returns the number taken.
+ */
+static int ring_take (display_ring_t *ring, int steal, alarm_t ***last)
+{
+    alarm_t *taken[DISPLAY_GRAB];
+    uint64_t head, tail;
+    int count, i;
+
+    head = __atomic_load_n (&ring->head, __ATOMIC_ACQUIRE);
+    do {
+        tail = __atomic_load_n (&ring->tail, __ATOMIC_ACQUIRE);
+        count = (int)(tail - head);
+        if (steal)
+            count = (count + 1) / 2;
+        if (count > DISPLAY_GRAB)
+            count = DISPLAY_GRAB;
+        if (count <= 0)
+            return overflow_take (ring, last);
+        for (i = 0; i < count; i++)
+            taken[i] = __atomic_load_n (
+                &ring->slots[(head + i) & (DISPLAY_RING - 1)],
+                __ATOMIC_RELAXED);
+
+        /*
+         * On failure "head" is reloaded with wherever another
+         * consumer moved it, and the slots must be read again.
+         */
+    } while (!__atomic_compare_exchange_n (&ring->head, &head, head + count,
+        0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+    // the alarms are ours only now, so only now link them
+    for (i = 0; i < count; i++) {
+        **last = taken[i];
+        *last = &taken[i]->link;
+    }
+    return count;
+}
+
+static int ring_depth (display_ring_t *ring)
+{
+    return (int)(__atomic_load_n (&ring->tail, __ATOMIC_ACQUIRE)
+        - __atomic_load_n (&ring->head, __ATOMIC_ACQUIRE));
+}
+
+static int ring_idle (display_ring_t *ring)
+{
+    return ring_depth (ring) == 0
+        && __atomic_load_n (&ring->overflow, __ATOMIC_RELAXED) == NULL;
+}
+
+static void worker_wake (display_worker_t *worker)
+{
+    int status;
+
+    status = pthread_mutex_lock (&worker->mutex);
+    if (status != 0)
+        err_abort (status, "Lock display worker");
+    status = pthread_cond_signal (&worker->wake);
+    if (status != 0)
+        err_abort (status, "Wake display worker");
+    status = pthread_mutex_unlock (&worker->mutex);
+    if (status != 0)
+        err_abort (status, "Unlock display worker");
+}
+
+static void *display_worker (void *arg)
+{
+    display_worker_t *worker = (display_worker_t*)arg, *victim;
+    alarm_t *batch, **last;
+    int count, stolen, started, status, i, p;
+
+    while (1) {
+        batch = NULL;
+        last = &batch;
+        count = 0;
+        stolen = 0;
+        for (p = 0; p < producer_count; p++)
+            count += ring_take (&worker->rings[p], 0, &last);
+
+        /*
+         * Nothing of our own: go round the other workers, starting
+         * with the next one so that thieves spread out, and take
+         * from the first that has something.
+         */
+        started = __atomic_load_n (&worker_count, __ATOMIC_ACQUIRE);
+        for (i = 1; count == 0 && i < started; i++) {
+            victim = &workers[(worker->index + i) % started];
+            for (p = 0; p < producer_count; p++)
+                count += ring_take (&victim->rings[p], 1, &last);
+            stolen = count;
+        }
+        if (count != 0) {
+            *last = NULL;
+            display_deliver (batch);
+            __atomic_fetch_add (&worker->delivered, count, __ATOMIC_RELAXED);
+            __atomic_fetch_add (&worker->stolen, stolen, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        /*
+         * Announce that we are going to sleep before the last
+         * look at our rings. A producer pushes before it looks at
+         * "sleeping", so either we see its alarms here or it sees
+         * the flag and wakes us.
+         */
+        status = pthread_mutex_lock (&worker->mutex);
+        if (status != 0)
+            err_abort (status, "Lock display worker");
+        __atomic_store_n (&worker->sleeping, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence (__ATOMIC_SEQ_CST);
+        for (p = 0; p < producer_count; p++)
+            if (!ring_idle (&worker->rings[p]))
+                break;
+        if (p == producer_count) {
+            status = pthread_cond_wait (&worker->wake, &worker->mutex);
+            if (status != 0)
+                err_abort (status, "Wait for display work");
+        }
+        __atomic_store_n (&worker->sleeping, 0, __ATOMIC_RELAXED);
+        status = pthread_mutex_unlock (&worker->mutex);
+        if (status != 0)
+            err_abort (status, "Unlock display worker");
+    }
+}
+
+/*
+ * Set up worker "index" and start its thread. Called with the
+ * route mutex held.
+ */
+static void worker_add (int index)
+{
+    display_worker_t *worker = &workers[index];
+    int status;
+
+    worker->index = index;
+    worker->rings = (display_ring_t*)calloc (producer_count,
+        sizeof (display_ring_t));
+    if (worker->rings == NULL)
+        errno_abort ("Allocate display rings");
+    status = pthread_mutex_init (&worker->mutex, NULL);
+    if (status != 0)
+        err_abort (status, "Init display mutex");
+    status = pthread_cond_init (&worker->wake, NULL);
+    if (status != 0)
+        err_abort (status, "Init display condition");
+
+    // thieves may look at it as soon as it is counted
+    __atomic_store_n (&worker_count, index + 1, __ATOMIC_RELEASE);
+    status = pthread_create (&worker->thread, NULL, display_worker, worker);
+    if (status != 0)
+        err_abort (status, "Create display worker");
+}
+
+void display_start (int workers_wanted, int producers,
+    display_deliver_t deliver)
+{
+    worker_max = workers_wanted;
+    producer_count = producers;
+    display_deliver = deliver;
+    workers = (display_worker_t*)calloc (worker_max,
+        sizeof (display_worker_t));
+    pushed = (char*)calloc (producer_count * worker_max, 1);
+    if (workers == NULL || pushed == NULL)
+        errno_abort ("Allocate display workers");
+}
+
+/*
+ * The worker for "type". The first time a type is seen it is
+ * given a worker of its own, started for it, or once there are
+ * worker_max of them, the next one round.
+ */
+static int route_of (uint16_t type)
+{
+    int route, status;
+
+    route = __atomic_load_n (&routes[type], __ATOMIC_ACQUIRE);
+    if (route != 0)
+        return route - 1;
+    status = pthread_mutex_lock (&route_mutex);
+    if (status != 0)
+        err_abort (status, "Lock display routes");
+    route = routes[type];
+    if (route == 0) {
+        route = route_count % worker_max + 1;
+        if (route_count < worker_max)
+            worker_add (route_count);
+        route_count++;
+        __atomic_store_n (&routes[type], route, __ATOMIC_RELEASE);
+    }
+    status = pthread_mutex_unlock (&route_mutex);
+    if (status != 0)
+        err_abort (status, "Unlock display routes");
+    return route - 1;
+}
+
+void display_route (uint16_t type)
+{
+    route_of (type);
+}
+
+/*
+ * Hand a detached batch of expired alarms to the workers. Only
+ * the thread that is "producer" may call this. It never calls
+ * the deliver function itself, however far behind the workers
+ * are, so the time it takes does not depend on what delivery
+ * costs.
+ */
+void display_submit (int producer, alarm_t *batch)
+{
+    alarm_t *alarm, *next, *top;
+    char *mine = pushed + producer * worker_max;
+    display_ring_t *ring;
+    uint64_t tail;
+    int overflow_count = 0, started, w, i;
+
+    for (alarm = batch; alarm != NULL; alarm = next) {
+        next = alarm->link;
+        w = route_of (alarm->type);
+        ring = &workers[w].rings[producer];
+        mine[w] = 1;
+        tail = ring->tail;
+        if (__atomic_load_n (&ring->overflow, __ATOMIC_RELAXED) != NULL
+            || tail - __atomic_load_n (&ring->head, __ATOMIC_ACQUIRE)
+            == DISPLAY_RING) {
+            top = __atomic_load_n (&ring->overflow, __ATOMIC_RELAXED);
+            do {
+                alarm->link = top;
+            } while (!__atomic_compare_exchange_n (&ring->overflow, &top,
+                alarm, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+            overflow_count++;
+            continue;
+        }
+        __atomic_store_n (&ring->slots[tail & (DISPLAY_RING - 1)], alarm,
+            __ATOMIC_RELAXED);
+        __atomic_store_n (&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    }
+    if (overflow_count != 0)
+        __atomic_fetch_add (&overflowed, overflow_count, __ATOMIC_RELAXED);
+
+    /*
+     * Wake whoever is asleep with work in their rings (see
+     * display_worker), and if a ring has backed up, one other
+     * sleeping worker to help with it.
+     */
+    __atomic_thread_fence (__ATOMIC_SEQ_CST);
+    started = __atomic_load_n (&worker_count, __ATOMIC_ACQUIRE);
+    for (w = 0; w < started; w++) {
+        if (!mine[w])
+            continue;
+        mine[w] = 0;
+        if (__atomic_load_n (&workers[w].sleeping, __ATOMIC_RELAXED))
+            worker_wake (&workers[w]);
+        ring = &workers[w].rings[producer];
+        if (ring_depth (ring) <= DISPLAY_GRAB && __atomic_load_n (
+            &ring->overflow, __ATOMIC_RELAXED) == NULL)
+            continue;
+        for (i = 1; i < started; i++)
+            if (__atomic_load_n (&workers[(w + i) % started].sleeping,
+                __ATOMIC_RELAXED)) {
+                worker_wake (&workers[(w + i) % started]);
+                break;
+            }
+    }
+}
+
+/*
+ * Print what each worker delivered to stderr. Registered with
+ * atexit.
+ */
+void display_report (void)
+{
+    unsigned long delivered, stolen;
+    int started, i;
+
+    started = __atomic_load_n (&worker_count, __ATOMIC_ACQUIRE);
+    for (i = 0; i < started; i++) {
+        delivered = __atomic_load_n (&workers[i].delivered, __ATOMIC_RELAXED);
+        stolen = __atomic_load_n (&workers[i].stolen, __ATOMIC_RELAXED);
+        if (delivered != 0)
+            fprintf (stderr, "display worker %d: %lu alarms (%lu stolen)\n",
+                i, delivered, stolen);
+    }
+    if (overflowed != 0)
+        fprintf (stderr, "%lu alarms overflowed the display rings\n",
+            overflowed);
+}
@@ -0,0 +1,59 @@
+#ifndef __alarm_display_h
+#define __alarm_display_h
+
+#include "alarm.h"
+
+/*
+ * Display workers take the formatting of expired alarms off the
+ * alarm threads. Each alarm type has a worker of its own, started
+ * the first time the type is routed, so that a type with a flood
+ * of alarms does not hold up the others, and the text for
+ * different types is made on different cores. display_start says
+ * how many workers there may be at most (the alarm program
+ * allows DISPLAY_WORKERS, unless -w says otherwise); once that
+ * many have been started, each new type shares a worker with
+ * earlier ones, going round them in turn.
+ *
+ * display_route gives "type" its worker now if it has none, and
+ * may start a thread to do so. display_submit would route a new
+ * type itself, but the alarm program routes each type as it
+ * creates an alarm, so that the alarm threads never have to.
+ *
+ * Every alarm thread (a "producer", numbered from 0) has a ring
+ * of DISPLAY_RING alarms to every worker, which it alone fills,
+ * so pushing takes no lock and no compare-and-swap. A worker
+ * empties its own rings, DISPLAY_GRAB alarms at a time. One that
+ * finds nothing to do steals half of what is waiting in another
+ * worker's rings, so a busy type can use the idle cores as well;
+ * this is why taking from a ring is a compare-and-swap on its
+ * head. Stolen alarms may be printed a little out of order with
+ * the rest of their type.
+ *
+ * A worker with nothing in its rings sleeps on a condition
+ * variable. A producer wakes it after pushing to its rings, and
+ * wakes some other sleeping worker, to steal, when a ring backs
+ * up by more than DISPLAY_GRAB alarms. If a ring is full, the
+ * producer puts the alarm on an overflow list instead, so that it
+ * neither waits nor delivers anything itself: the alarm threads
+ * only time alarms, and what delivery costs does not delay the
+ * next deadline (bench/jitter_bench.c measures this).
+ *
+ * What delivering means is up to the caller: the deliver function
+ * passed to display_start is called by the workers, without any
+ * lock held, with a chain of alarms linked through "link", and
+ * must free them. The alarm program's formats their messages for
+ * the output sink.
+ */
+#define DISPLAY_RING    1024        /* alarms per ring; a power of two */
+#define DISPLAY_GRAB    64          /* most alarms taken at once */
+#define DISPLAY_WORKERS 64          /* most workers the alarm program starts */
+
+typedef void (*display_deliver_t) (alarm_t *batch);
+
+extern void display_start (int workers, int producers,
+    display_deliver_t deliver);
+extern void display_route (uint16_t type);
+extern void display_submit (int producer, alarm_t *batch);
+extern void display_report (void);
+
+#endif
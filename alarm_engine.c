@@ -0,0 +1,219 @@
+/*
+ * alarm_engine.c
+ *
+ * Expiry engines for the alarm thread. See alarm_engine.h.
+ */
+#include "errors.h"
+#include "alarm_engine.h"
+#ifdef __linux__
+# include <sys/epoll.h>
+# include <sys/timerfd.h>
+# include <sys/eventfd.h>
+#endif
+
+/*
+ * Condition variable engine.
+ */
+static void cond_init (engine_t *engine)
+{
+    pthread_condattr_t attr;
+    int status;
+
+    /*
+     * Time the wait against CLOCK_MONOTONIC, like the deadlines.
+     */
+    status = pthread_condattr_init (&attr);
+    if (status != 0)
+        err_abort (status, "Init condattr");
+    status = pthread_condattr_setclock (&attr, CLOCK_MONOTONIC);
+    if (status != 0)
+        err_abort (status, "Set cond clock");
+    status = pthread_cond_init (&engine->cond, &attr);
+    if (status != 0)
+        err_abort (status, "Init cond");
+    pthread_condattr_destroy (&attr);
+}
+
+static void cond_wait (
+    engine_t *engine, lock_t *lock, uint64_t when)
+{
+    struct timespec cond_time;
+    int status;
+
+    if (when != 0) {
+        cond_time.tv_sec = when / NSEC_PER_SEC;
+        cond_time.tv_nsec = when % NSEC_PER_SEC;
+        status = lock_cond_wait (&engine->cond, lock, &cond_time,
+            &engine->signalled);
+        if (status != 0 && status != ETIMEDOUT)
+            err_abort (status, "Cond timedwait");
+    } else {
+        status = lock_cond_wait (&engine->cond, lock, NULL,
+            &engine->signalled);
+        if (status != 0)
+            err_abort (status, "Wait on cond");
+    }
+}
+
+static void cond_wake (engine_t *engine, uint64_t when)
+{
+    int status;
+
+    (void)when;                 // the waiter looks at the store again
+    engine->signalled = alarm_now ();   // the mutex is held
+    status = pthread_cond_signal (&engine->cond);
+    if (status != 0)
+        err_abort (status, "Signal cond");
+}
+
+/*
+ * The waiter only releases the mutex inside pthread_cond_wait, so
+ * signalling with the mutex held cannot fall between its last
+ * look at the queue and the wait.
+ */
+static void cond_kick (engine_t *engine, lock_t *lock, lock_site_t site)
+{
+    lock_acquire (lock, site);
+    cond_wake (engine, 0);
+    lock_release (lock);
+}
+
+static const engine_ops_t cond_engine_ops = {
+    "cond", cond_init, cond_wait, cond_wake, cond_kick
+};
+
+#ifdef __linux__
+/*
+ * timerfd engine.
+ */
+static void timer_arm (engine_t *engine, uint64_t when)
+{
+    struct itimerspec spec;
+
+    if (when == engine->armed)
+        return;
+    spec.it_interval.tv_sec = 0;
+    spec.it_interval.tv_nsec = 0;
+    spec.it_value.tv_sec = when / NSEC_PER_SEC;     /* 0 disarms */
+    spec.it_value.tv_nsec = when % NSEC_PER_SEC;
+    if (timerfd_settime (engine->timerfd, TFD_TIMER_ABSTIME, &spec, NULL) < 0)
+        errno_abort ("Arm timerfd");
+    engine->armed = when;
+}
+
+static void timer_init (engine_t *engine)
+{
+    struct epoll_event event;
+
+    engine->timerfd = timerfd_create (
+        CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (engine->timerfd < 0)
+        errno_abort ("Create timerfd");
+    engine->epollfd = epoll_create1 (EPOLL_CLOEXEC);
+    if (engine->epollfd < 0)
+        errno_abort ("Create epoll");
+    event.events = EPOLLIN;
+    event.data.fd = engine->timerfd;
+    if (epoll_ctl (engine->epollfd, EPOLL_CTL_ADD,
+        engine->timerfd, &event) < 0)
+        errno_abort ("Add timerfd to epoll");
+    engine->eventfd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (engine->eventfd < 0)
+        errno_abort ("Create eventfd");
+    event.events = EPOLLIN;
+    event.data.fd = engine->eventfd;
+    if (epoll_ctl (engine->epollfd, EPOLL_CTL_ADD,
+        engine->eventfd, &event) < 0)
+        errno_abort ("Add eventfd to epoll");
+    engine->armed = 0;
+}
+
+/*
+ * Make sure the timer is set to "when", then drop the mutex and
+ * wait for it, or for a kick. A thread that inserts an earlier
+ * alarm while we wait rearms the timer itself, and epoll wakes us
+ * at the new deadline.
+ */
+static void timer_wait (
+    engine_t *engine, lock_t *lock, uint64_t when)
+{
+    struct epoll_event event;
+    unsigned long long expirations;
+    lock_site_t site = lock->site;
+    int count;
+
+    timer_arm (engine, when);
+    lock_release (lock);
+    do
+        count = epoll_wait (engine->epollfd, &event, 1, -1);
+    while (count < 0 && errno == EINTR);
+    if (count < 0)
+        errno_abort ("Wait on epoll");
+    lock_acquire (lock, site);
+
+    /*
+     * If the timer fired it is no longer set. Reading it under the
+     * mutex keeps a concurrent rearm from being mistaken for a
+     * fired timer.
+     */
+    if (read (engine->timerfd, &expirations, sizeof (expirations)) > 0)
+        engine->armed = 0;
+    else if (errno != EAGAIN)
+        errno_abort ("Read timerfd");
+    if (read (engine->eventfd, &expirations, sizeof (expirations)) < 0
+        && errno != EAGAIN)
+        errno_abort ("Read eventfd");
+}
+
+static void timer_wake (engine_t *engine, uint64_t when)
+{
+    timer_arm (engine, when);
+}
+
+/*
+ * The eventfd stays readable until timer_wait reads it, so a kick
+ * that arrives before the waiter reaches epoll_wait is not lost.
+ */
+static void timer_kick (engine_t *engine, lock_t *lock, lock_site_t site)
+{
+    uint64_t one = 1;
+
+    (void)lock;                 // writing the eventfd needs no lock
+    (void)site;
+    if (write (engine->eventfd, &one, sizeof (one)) < 0 && errno != EAGAIN)
+        errno_abort ("Write eventfd");
+}
+
+static const engine_ops_t timer_engine_ops = {
+    "timerfd", timer_init, timer_wait, timer_wake, timer_kick
+};
+#endif
+
+/*
+ * The first engine is the default.
+ */
+const engine_ops_t *engine_backends[] = {
+    &cond_engine_ops,
+#ifdef __linux__
+    &timer_engine_ops,
+#endif
+    NULL
+};
+
+/*
+ * Set up the engine called "name" (or the default if "name" is
+ * NULL). Returns 0 if there is no such engine.
+ */
+int engine_init (engine_t *engine, const char *name)
+{
+    int i;
+
+    for (i = 0; engine_backends[i] != NULL; i++) {
+        if (name == NULL || strcmp (name, engine_backends[i]->name) == 0) {
+            engine->ops = engine_backends[i];
+            engine->ops->init (engine);
+            return 1;
+        }
+    }
+    return 0;
+}
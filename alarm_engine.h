@@ -0,0 +1,63 @@
+#ifndef __alarm_engine_h
+#define __alarm_engine_h
+
+#include <pthread.h>
+#include <time.h>
+#include "alarm.h"
+#include "alarm_lock.h"
+
+/*
+ * An expiry engine is how the alarm thread waits for the earliest
+ * deadline in the store. One is chosen by name at startup.
+ *
+ *  wait    called by the alarm thread with the store mutex held;
+ *          releases it, waits until "when" (forever if "when" is
+ *          0) or until woken, and returns with the mutex held
+ *  wake    called with the store mutex held when the earliest
+ *          deadline has changed to "when" (0 if the store is now
+ *          empty)
+ *  kick    called WITHOUT the store mutex to make a thread in
+ *          wait return now, for instance because commands were
+ *          queued for it; takes the mutex itself, for "site",
+ *          if the engine needs it to avoid losing the wakeup
+ *
+ * Deadlines are CLOCK_MONOTONIC nanoseconds (see alarm.h), and
+ * both engines wait for them with nanosecond precision.
+ *
+ * The "cond" engine waits on a condition variable. The "timerfd"
+ * engine (Linux only) keeps a single timerfd armed to the
+ * earliest deadline and waits for it in epoll; wake simply rearms
+ * the timer, so nothing has to be signalled. It kicks the waiter
+ * through an eventfd in the same epoll set, without the mutex.
+ */
+typedef struct engine_tag engine_t;
+
+typedef struct engine_ops_tag {
+    const char          *name;
+    void                (*init) (engine_t *engine);
+    void                (*wait) (
+        engine_t *engine, lock_t *lock, uint64_t when);
+    void                (*wake) (engine_t *engine, uint64_t when);
+    void                (*kick) (
+        engine_t *engine, lock_t *lock, lock_site_t site);
+} engine_ops_t;
+
+struct engine_tag {
+    const engine_ops_t  *ops;
+    pthread_cond_t      cond;       /* cond engine */
+    uint64_t            signalled;  /* when cond was last signalled */
+    int                 timerfd;    /* timerfd engine */
+    int                 epollfd;
+    int                 eventfd;    /* kicks the epoll_wait */
+    uint64_t            armed;      /* deadline the timerfd is set to */
+};
+
+extern const engine_ops_t *engine_backends[];
+
+extern int engine_init (engine_t *engine, const char *name);
+
+#define engine_wait(e,m,when)   ((e)->ops->wait ((e), (m), (when)))
+#define engine_wake(e,when)     ((e)->ops->wake ((e), (when)))
+#define engine_kick(e,m,site)   ((e)->ops->kick ((e), (m), (site)))
+
+#endif
@@ -0,0 +1,150 @@
+/*
+ * alarm_heap.c
+ *
+ * 4-ary min-heap alarm store. See alarm_heap.h.
+ */
+#include "errors.h"
+#include "alarm_heap.h"
+
+#define HEAP_PARENT(i)  (((i) - 1) / HEAP_ARITY)
+#define HEAP_CHILD(i)   ((i) * HEAP_ARITY + 1)
+
+/*
+ * Store an alarm in a slot and record the slot in the alarm.
+ */
+static void heap_set (heap_t *heap, int index, alarm_t *alarm)
+{
+    heap->nodes[index] = alarm;
+    alarm->heap_index = index;
+}
+
+static void sift_up (heap_t *heap, int index)
+{
+    alarm_t *alarm = heap->nodes[index];
+    int parent;
+
+    while (index > 0) {
+        parent = HEAP_PARENT (index);
+        if (heap->nodes[parent]->time <= alarm->time)
+            break;
+        heap_set (heap, index, heap->nodes[parent]);
+        index = parent;
+    }
+    heap_set (heap, index, alarm);
+}
+
+static void sift_down (heap_t *heap, int index)
+{
+    alarm_t *alarm = heap->nodes[index];
+    int child, best, last;
+
+    while ((child = HEAP_CHILD (index)) < heap->count) {
+        best = child;
+        last = child + HEAP_ARITY;
+        if (last > heap->count)
+            last = heap->count;
+        for (child++; child < last; child++)
+            if (heap->nodes[child]->time < heap->nodes[best]->time)
+                best = child;
+        if (heap->nodes[best]->time >= alarm->time)
+            break;
+        heap_set (heap, index, heap->nodes[best]);
+        index = best;
+    }
+    heap_set (heap, index, alarm);
+}
+
+void heap_init (heap_t *heap)
+{
+    heap->nodes = NULL;
+    heap->count = 0;
+    heap->size = 0;
+}
+
+void heap_insert (heap_t *heap, alarm_t *alarm)
+{
+    alarm_t **nodes;
+    int size;
+
+    if (heap->count == heap->size) {
+        size = heap->size == 0 ? 64 : heap->size * 2;
+        nodes = (alarm_t**)realloc (heap->nodes, size * sizeof (alarm_t*));
+        if (nodes == NULL)
+            errno_abort ("Grow heap");
+        heap->nodes = nodes;
+        heap->size = size;
+    }
+    heap_set (heap, heap->count++, alarm);
+    sift_up (heap, alarm->heap_index);
+}
+
+/*
+ * Remove an alarm from anywhere in the heap: move the last node
+ * into its slot and sift that node whichever way it needs to go.
+ */
+void heap_remove (heap_t *heap, alarm_t *alarm)
+{
+    int index = alarm->heap_index;
+    alarm_t *last;
+
+    last = heap->nodes[--heap->count];
+    alarm->heap_index = -1;
+    if (last == alarm)
+        return;
+    heap_set (heap, index, last);
+    heap_update (heap, last);
+}
+
+/*
+ * Restore heap order after alarm->time changed in place.
+ */
+void heap_update (heap_t *heap, alarm_t *alarm)
+{
+    int index = alarm->heap_index;
+
+    if (index > 0
+        && heap->nodes[HEAP_PARENT (index)]->time > alarm->time)
+        sift_up (heap, index);
+    else
+        sift_down (heap, index);
+}
+
+/*
+ * Remove every alarm that is due at "now" and return them as a
+ * list chained through alarm->link, earliest first, or NULL if
+ * none is.
+ */
+alarm_t *heap_expire (heap_t *heap, uint64_t now)
+{
+    alarm_t *head = NULL, **tail = &head, *alarm;
+
+    while (heap->count > 0 && heap->nodes[0]->time <= now) {
+        alarm = heap->nodes[0];
+        heap_remove (heap, alarm);
+        *tail = alarm;
+        tail = &alarm->link;
+    }
+    *tail = NULL;
+    return head;
+}
+
+int heap_next (heap_t *heap, uint64_t *when)
+{
+    if (heap->count == 0)
+        return 0;
+    *when = heap->nodes[0]->time;
+    return 1;
+}
+
+/*
+ * Call "fn" for every alarm in the heap, in array order. "fn"
+ * must not modify the heap.
+ */
+void heap_foreach (
+    heap_t *heap, void (*fn)(alarm_t *, void *), void *arg)
+{
+    int i;
+
+    for (i = 0; i < heap->count; i++)
+        fn (heap->nodes[i], arg);
+}
@@ -0,0 +1,33 @@
+#ifndef __alarm_heap_h
+#define __alarm_heap_h
+
+#include "alarm.h"
+
+/*
+ * An array-backed 4-ary min-heap ordered by alarm->time. Each
+ * alarm records its array slot in alarm->heap_index, so that an
+ * alarm whose time changed can be sifted in place and an alarm
+ * can be removed from the middle of the heap in O(log n).
+ *
+ * A 4-ary heap is shallower than a binary one, and the four
+ * children of a node sit next to each other in the array, so a
+ * sift-down touches fewer cache lines.
+ */
+#define HEAP_ARITY      4
+
+typedef struct heap_tag {
+    alarm_t             **nodes;
+    int                 count;
+    int                 size;       /* allocated slots */
+} heap_t;
+
+extern void heap_init (heap_t *heap);
+extern void heap_insert (heap_t *heap, alarm_t *alarm);
+extern void heap_remove (heap_t *heap, alarm_t *alarm);
+extern void heap_update (heap_t *heap, alarm_t *alarm);
+extern alarm_t *heap_expire (heap_t *heap, uint64_t now);
+extern int heap_next (heap_t *heap, uint64_t *when);
+extern void heap_foreach (
+    heap_t *heap, void (*fn)(alarm_t *, void *), void *arg);
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * alarm_index.c
+ *
+ * Hash index from alarm_id to alarm. See alarm_index.h.
+ */
+#include "errors.h"
+#include "alarm_index.h"
+
+#define INDEX_INITIAL   1024
+
+/*
+ * Mix the alarm_id (the MurmurHash3 finaliser) and keep the high
+ * bits. Plain Fibonacci hashing would spread sequential IDs too,
+ * but shard_of picks the shard from the high bits of exactly that
+ * hash, so every ID in one shard's index would land in the same
+ * fraction of its table.
+ */
+static unsigned int index_hash (alarm_index_t *index, int alarm_id)
+{
+    uint32_t hash = (uint32_t)alarm_id;
+
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bU;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35U;
+    hash ^= hash >> 16;
+    return (unsigned int)(hash >> index->shift);
+}
+
+static void index_alloc (alarm_index_t *index, unsigned int size)
+{
+    index->entries = (index_entry_t*)calloc (size, sizeof (index_entry_t));
+    if (index->entries == NULL)
+        errno_abort ("Allocate index");
+    index->mask = size - 1;
+    index->shift = 32;
+    while (size > 1) {
+        index->shift--;
+        size >>= 1;
+    }
+    index->count = 0;
+}
+
+static void index_grow (alarm_index_t *index)
+{
+    index_entry_t *old = index->entries;
+    unsigned int size = index->mask + 1, i;
+
+    index_alloc (index, size * 2);
+    for (i = 0; i < size; i++)
+        if (old[i].alarm != NULL)
+            index_insert (index, old[i].alarm);
+    free (old);
+}
+
+void index_init (alarm_index_t *index)
+{
+    index_alloc (index, INDEX_INITIAL);
+}
+
+alarm_t *index_find (alarm_index_t *index, int alarm_id)
+{
+    unsigned int slot = index_hash (index, alarm_id);
+
+    while (index->entries[slot].alarm != NULL) {
+        if (index->entries[slot].alarm_id == alarm_id)
+            return index->entries[slot].alarm;
+        slot = (slot + 1) & index->mask;
+    }
+    return NULL;
+}
+
+/*
+ * Add an alarm under its alarm_id. Returns 0, without adding it,
+ * if that alarm_id is already in the index.
+ */
+int index_insert (alarm_index_t *index, alarm_t *alarm)
+{
+    unsigned int slot;
+
+    if ((unsigned int)(index->count + 1) * 2 > index->mask + 1)
+        index_grow (index);
+    slot = index_hash (index, alarm->alarm_id);
+    while (index->entries[slot].alarm != NULL) {
+        if (index->entries[slot].alarm_id == alarm->alarm_id)
+            return 0;
+        slot = (slot + 1) & index->mask;
+    }
+    index->entries[slot].alarm_id = alarm->alarm_id;
+    index->entries[slot].alarm = alarm;
+    index->count++;
+    return 1;
+}
+
+/*
+ * Remove the entry for alarm_id and return its alarm (NULL if
+ * there was none). The entries after it in the same probe run are
+ * shifted back over the hole if that brings them closer to their
+ * home slot, so that no lookup ever stops short at the hole.
+ */
+alarm_t *index_remove (alarm_index_t *index, int alarm_id)
+{
+    unsigned int hole, slot, home;
+    alarm_t *alarm;
+
+    hole = index_hash (index, alarm_id);
+    while (index->entries[hole].alarm != NULL
+        && index->entries[hole].alarm_id != alarm_id)
+        hole = (hole + 1) & index->mask;
+    alarm = index->entries[hole].alarm;
+    if (alarm == NULL)
+        return NULL;
+    slot = hole;
+    while (1) {
+        slot = (slot + 1) & index->mask;
+        if (index->entries[slot].alarm == NULL)
+            break;
+        home = index_hash (index, index->entries[slot].alarm_id);
+        /*
+         * Leave the entry where it is if its home slot lies
+         * cyclically in (hole, slot].
+         */
+        if (((slot - home) & index->mask) < ((slot - hole) & index->mask))
+            continue;
+        index->entries[hole] = index->entries[slot];
+        hole = slot;
+    }
+    index->entries[hole].alarm = NULL;
+    index->count--;
+    return alarm;
+}
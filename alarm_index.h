@@ -0,0 +1,34 @@
+#ifndef __alarm_index_h
+#define __alarm_index_h
+
+#include "alarm.h"
+
+/*
+ * An open-addressing hash index from alarm_id to alarm_t, kept
+ * alongside the (time ordered) alarm store so that Change_Alarm,
+ * Cancel_Alarm and the duplicate check in Start_Alarm do not have
+ * to search the store. Collisions are resolved by linear probing,
+ * and removal shifts the following entries back instead of
+ * leaving tombstones, so lookups stay short however many alarms
+ * come and go. The table doubles when it becomes half full.
+ *
+ * Like the store, the index does no locking of its own.
+ */
+typedef struct index_entry_tag {
+    int                 alarm_id;
+    alarm_t             *alarm;     /* NULL if the entry is empty */
+} index_entry_t;
+
+typedef struct alarm_index_tag {
+    index_entry_t       *entries;
+    unsigned int        mask;       /* table size - 1 */
+    int                 shift;      /* 32 - log2 (table size) */
+    int                 count;
+} alarm_index_t;
+
+extern void index_init (alarm_index_t *index);
+extern alarm_t *index_find (alarm_index_t *index, int alarm_id);
+extern int index_insert (alarm_index_t *index, alarm_t *alarm);
+extern alarm_t *index_remove (alarm_index_t *index, int alarm_id);
+
+#endif
@@ -0,0 +1,119 @@
+/*
+ * alarm_json.c
+ *
+ * Hand-rolled JSON-lines formatter. See alarm_json.h.
+ */
+#include <string.h>
+#include "alarm_json.h"
+
+static const char hex[] = "0123456789abcdef";
+
+static void json_raw (json_t *json, const char *text, size_t length)
+{
+    memcpy (json->data + json->length, text, length);
+    json->length += length;
+}
+
+static void json_digits (json_t *json, uint64_t value)
+{
+    char digits[20];
+    int count = 0;
+
+    do {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    while (count > 0)
+        json->data[json->length++] = digits[--count];
+}
+
+/*
+ * Write ,"<key>": -- the keys are the program's own, and need no
+ * escaping.
+ */
+static void json_key (json_t *json, const char *key)
+{
+    json->data[json->length++] = ',';
+    json->data[json->length++] = '"';
+    json_raw (json, key, strlen (key));
+    json->data[json->length++] = '"';
+    json->data[json->length++] = ':';
+}
+
+static void json_quote (json_t *json, const char *value)
+{
+    char *out = json->data + json->length;
+    unsigned char c;
+
+    *out++ = '"';
+    while ((c = (unsigned char)*value++) != '\0') {
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            *out++ = c;
+            continue;
+        }
+        *out++ = '\\';
+        switch (c) {
+        case '"':
+        case '\\':
+            *out++ = c;
+            break;
+        case '\n':
+            *out++ = 'n';
+            break;
+        case '\t':
+            *out++ = 't';
+            break;
+        case '\r':
+            *out++ = 'r';
+            break;
+        default:
+            *out++ = 'u';
+            *out++ = '0';
+            *out++ = '0';
+            *out++ = hex[c >> 4];
+            *out++ = hex[c & 0xf];
+            break;
+        }
+    }
+    *out++ = '"';
+    json->length = out - json->data;
+}
+
+void json_begin (json_t *json, char *buffer, const char *event,
+    uint64_t mono, uint64_t wall)
+{
+    json->data = buffer;
+    json->length = 0;
+    json_raw (json, "{\"event\":", 9);
+    json_quote (json, event);
+    json_uint (json, "mono_ns", mono);
+    json_uint (json, "wall_ns", wall);
+}
+
+void json_int (json_t *json, const char *key, int64_t value)
+{
+    json_key (json, key);
+    if (value < 0) {
+        json->data[json->length++] = '-';
+        json_digits (json, -(uint64_t)value);
+    } else
+        json_digits (json, value);
+}
+
+void json_uint (json_t *json, const char *key, uint64_t value)
+{
+    json_key (json, key);
+    json_digits (json, value);
+}
+
+void json_string (json_t *json, const char *key, const char *value)
+{
+    json_key (json, key);
+    json_quote (json, value);
+}
+
+size_t json_end (json_t *json)
+{
+    json_raw (json, "}\n", 2);
+    return json->length;
+}
@@ -0,0 +1,40 @@
+#ifndef __alarm_json_h
+#define __alarm_json_h
+
+#include "alarm.h"
+
+/*
+ * JSON-lines output (-j). Each event is one JSON object on a line
+ * of its own, built by hand straight into the caller's buffer: no
+ * printf, no allocation. json_begin starts an object with the
+ * fields every event has,
+ *
+ *  {"event":"<event>","mono_ns":<n>,"wall_ns":<n>
+ *
+ * the CLOCK_MONOTONIC and CLOCK_REALTIME times of the event in
+ * nanoseconds. json_int, json_uint and json_string add a field
+ * each, and json_end closes the object, adds the newline and
+ * returns the length of the line.
+ *
+ * Strings are escaped as JSON requires; other bytes are copied as
+ * they are. Nothing is checked against the size of the buffer, so
+ * it must have room for JSON_LINE bytes, which is enough for any
+ * event the alarm program writes: a handful of numbers and short
+ * keys, a type of up to 64 characters and a message of up to 63,
+ * each of which may grow sixfold when escaped.
+ */
+#define JSON_LINE       1024
+
+typedef struct json_tag {
+    char                *data;
+    size_t              length;
+} json_t;
+
+extern void json_begin (json_t *json, char *buffer, const char *event,
+    uint64_t mono, uint64_t wall);
+extern void json_int (json_t *json, const char *key, int64_t value);
+extern void json_uint (json_t *json, const char *key, uint64_t value);
+extern void json_string (json_t *json, const char *key, const char *value);
+extern size_t json_end (json_t *json);
+
+#endif
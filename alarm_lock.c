@@ -0,0 +1,197 @@
+/*
+ * alarm_lock.c
+ *
+ * Instrumented mutex. See alarm_lock.h.
+ */
+#include "errors.h"
+#include "alarm_lock.h"
+
+static const char *lock_site_names[LOCK_SITES] = {
+    "alarm_thread", "Start_Alarm", "Change_Alarm", "Cancel_Alarm",
+    "View_Alarms", "batch", "replay", "report"
+};
+
+/*
+ * Only the owning thread writes a table, but lock_stats reads
+ * them all while they are in use, so the counters are read and
+ * written with (relaxed) atomics; the owner needs no
+ * read-modify-write to update them.
+ */
+typedef struct lock_table_tag {
+    struct lock_table_tag *next;
+    unsigned long       wait[LOCK_SITES][LOCK_HIST];
+    unsigned long       hold[LOCK_SITES][LOCK_HIST];
+    uint64_t            wait_total[LOCK_SITES];
+    uint64_t            hold_total[LOCK_SITES];
+} lock_table_t;
+
+static __thread lock_table_t *lock_table;
+static lock_table_t *lock_tables;   /* every thread's, newest first */
+
+static void lock_add (unsigned long *hist, uint64_t *total, uint64_t time)
+{
+    int bucket = time == 0 ? 0 : 63 - __builtin_clzll (time);
+
+    if (bucket >= LOCK_HIST)
+        bucket = LOCK_HIST - 1;
+    __atomic_store_n (&hist[bucket],
+        __atomic_load_n (&hist[bucket], __ATOMIC_RELAXED) + 1,
+        __ATOMIC_RELAXED);
+    __atomic_store_n (total,
+        __atomic_load_n (total, __ATOMIC_RELAXED) + time, __ATOMIC_RELAXED);
+}
+
+static lock_table_t *lock_mine (void)
+{
+    lock_table_t *table = lock_table;
+
+    if (table != NULL)
+        return table;
+    table = (lock_table_t*)calloc (1, sizeof (lock_table_t));
+    if (table == NULL)
+        errno_abort ("Allocate lock table");
+    table->next = __atomic_load_n (&lock_tables, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n (&lock_tables, &table->next, table,
+        1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    lock_table = table;
+    return table;
+}
+
+void lock_init (lock_t *lock)
+{
+    int status;
+
+    status = pthread_mutex_init (&lock->mutex, NULL);
+    if (status != 0)
+        err_abort (status, "Init mutex");
+}
+
+void lock_acquire (lock_t *lock, lock_site_t site)
+{
+    lock_table_t *table = lock_mine ();
+    uint64_t start, now;
+    int status;
+
+    status = pthread_mutex_trylock (&lock->mutex);
+    if (status == 0) {
+        now = alarm_now ();
+        lock_add (table->wait[site], &table->wait_total[site], 0);
+    } else if (status == EBUSY) {
+        start = alarm_now ();
+        status = pthread_mutex_lock (&lock->mutex);
+        if (status != 0)
+            err_abort (status, "Lock mutex");
+        now = alarm_now ();
+        lock_add (table->wait[site], &table->wait_total[site], now - start);
+    } else
+        err_abort (status, "Lock mutex");
+    lock->since = now;
+    lock->site = site;
+}
+
+void lock_release (lock_t *lock)
+{
+    lock_table_t *table = lock_mine ();
+    lock_site_t site = lock->site;
+    int status;
+
+    lock_add (table->hold[site], &table->hold_total[site],
+        alarm_now () - lock->since);
+    status = pthread_mutex_unlock (&lock->mutex);
+    if (status != 0)
+        err_abort (status, "Unlock mutex");
+}
+
+/*
+ * Wait on "cond" until "when" (forever if it is NULL). Returns
+ * what pthread_cond_timedwait or pthread_cond_wait did.
+ *
+ * The mutex is taken back inside pthread, so the time spent
+ * waiting for it is counted from when the wait ended: the time
+ * the signaller stored in "*signalled", or "when" if the wait
+ * timed out. A wakeup with neither (a spurious one) counts as no
+ * wait at all.
+ */
+int lock_cond_wait (pthread_cond_t *cond, lock_t *lock,
+    const struct timespec *when, uint64_t *signalled)
+{
+    lock_table_t *table = lock_mine ();
+    lock_site_t site = lock->site;
+    uint64_t now, woken;
+    int status;
+
+    lock_add (table->hold[site], &table->hold_total[site],
+        alarm_now () - lock->since);
+    *signalled = 0;
+    if (when != NULL)
+        status = pthread_cond_timedwait (cond, &lock->mutex, when);
+    else
+        status = pthread_cond_wait (cond, &lock->mutex);
+    now = alarm_now ();
+    if (status == ETIMEDOUT)
+        woken = (uint64_t)when->tv_sec * NSEC_PER_SEC + when->tv_nsec;
+    else if (*signalled != 0)
+        woken = *signalled;
+    else
+        woken = now;
+    lock_add (table->wait[site], &table->wait_total[site],
+        now > woken ? now - woken : 0);
+    lock->since = now;
+    lock->site = site;
+    return status;
+}
+
+/*
+ * Print the wait and hold histograms of every site that has taken
+ * a lock, summed over all threads, to "out".
+ */
+void lock_stats (FILE *out)
+{
+    unsigned long wait[LOCK_HIST], hold[LOCK_HIST], waits, holds;
+    uint64_t wait_total, hold_total;
+    lock_table_t *table;
+    int site, i;
+
+    fprintf (out, "Lock wait and hold times (ns):\n");
+    for (site = 0; site < LOCK_SITES; site++) {
+        memset (wait, 0, sizeof (wait));
+        memset (hold, 0, sizeof (hold));
+        wait_total = hold_total = 0;
+        waits = holds = 0;
+        for (table = __atomic_load_n (&lock_tables, __ATOMIC_ACQUIRE);
+            table != NULL; table = table->next) {
+            for (i = 0; i < LOCK_HIST; i++) {
+                wait[i] += __atomic_load_n (&table->wait[site][i],
+                    __ATOMIC_RELAXED);
+                hold[i] += __atomic_load_n (&table->hold[site][i],
+                    __ATOMIC_RELAXED);
+            }
+            wait_total += __atomic_load_n (&table->wait_total[site],
+                __ATOMIC_RELAXED);
+            hold_total += __atomic_load_n (&table->hold_total[site],
+                __ATOMIC_RELAXED);
+        }
+        for (i = 0; i < LOCK_HIST; i++) {
+            waits += wait[i];
+            holds += hold[i];
+        }
+        if (waits == 0 && holds == 0)
+            continue;
+        fprintf (out, "%s: %lu acquired, mean wait %.0f, %lu held,"
+            " mean hold %.0f\n", lock_site_names[site], waits,
+            waits ? (double)wait_total / waits : 0.0, holds,
+            holds ? (double)hold_total / holds : 0.0);
+        fprintf (out, "  %21s %10s %10s\n", "", "wait", "hold");
+        for (i = 0; i < LOCK_HIST; i++)
+            if (wait[i] == 0 && hold[i] == 0)
+                continue;
+            else if (i == LOCK_HIST - 1)    // holds everything larger
+                fprintf (out, "  %10lu%-11s %10lu %10lu\n",
+                    1UL << i, " or more", wait[i], hold[i]);
+            else
+                fprintf (out, "  %10lu-%-10lu %10lu %10lu\n",
+                    i == 0 ? 0UL : 1UL << i, (2UL << i) - 1,
+                    wait[i], hold[i]);
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef __alarm_lock_h
+#define __alarm_lock_h
+
+#include <pthread.h>
+#include <stdio.h>
+#include "alarm.h"
+
+/*
+ * An instrumented mutex. Every acquisition names its call site,
+ * and the lock records how long the caller waited to get it and,
+ * when it is released, how long it was held, in nanoseconds, in a
+ * log2 histogram for that site: bucket i counts the times from
+ * 2^i to 2^(i+1)-1 (bucket 0 also holds 0, and the last bucket
+ * everything larger).
+ *
+ * The histograms are per thread, so recording takes no lock and
+ * shares no cache line; each thread's table is allocated the
+ * first time it records anything and lives as long as the
+ * process. lock_stats adds up every thread's table and prints
+ * the result. An acquisition that gets the mutex at once costs a
+ * single clock read more than a plain pthread_mutex_lock.
+ *
+ * lock_cond_wait waits on a condition variable with the lock,
+ * like pthread_cond_wait: the hold ends when the wait starts, and
+ * a new one starts when it returns, at the same site. Taking the
+ * mutex back after the wakeup is recorded as a wait at that site.
+ * pthread gives no way to see when that started, so whoever
+ * signals the condition variable stores the time (alarm_now) in
+ * "*signalled", with the mutex held; lock_cond_wait clears it
+ * before waiting, and a timed out wait counts from its deadline.
+ */
+#define LOCK_HIST       32
+
+typedef enum lock_site_tag {
+    LOCK_ALARM_THREAD, LOCK_START, LOCK_CHANGE, LOCK_CANCEL, LOCK_VIEW,
+    LOCK_BATCH, LOCK_REPLAY, LOCK_REPORT, LOCK_SITES
+} lock_site_t;
+
+typedef struct lock_tag {
+    pthread_mutex_t     mutex;
+    uint64_t            since;      /* when the holder got it */
+    lock_site_t         site;       /* where the holder got it */
+} lock_t;
+
+extern void lock_init (lock_t *lock);
+extern void lock_acquire (lock_t *lock, lock_site_t site);
+extern void lock_release (lock_t *lock);
+extern int lock_cond_wait (pthread_cond_t *cond, lock_t *lock,
+    const struct timespec *when, uint64_t *signalled);
+extern void lock_stats (FILE *out);
+
+#endif
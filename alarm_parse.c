@@ -0,0 +1,199 @@
+/*
+ * alarm_parse.c
+ *
+ * Single-pass, in-place command parser. See alarm_parse.h.
+ */
+#include <ctype.h>
+#include <limits.h>
+#include <string.h>
+#include "alarm_parse.h"
+
+static char *skip_space (char *text)
+{
+    while (isspace ((unsigned char)*text))
+        text++;
+    return text;
+}
+
+/*
+ * Match a literal at *text and step past it.
+ */
+static int expect (char **text, const char *literal, size_t length)
+{
+    if (strncmp (*text, literal, length) != 0)
+        return 0;
+    *text += length;
+    return 1;
+}
+
+/*
+ * Parse an alarm_id, a decimal integer with no sign, which may be
+ * preceded by whitespace, and step past it. IDs cannot be
+ * negative: -1 marks a legacy alarm, which has no ID.
+ */
+static int parse_int (char **text, int *value)
+{
+    char *p = skip_space (*text);
+    long long result = 0;
+
+    if (!isdigit ((unsigned char)*p))
+        return 0;
+    while (isdigit ((unsigned char)*p)) {
+        result = result * 10 + (*p++ - '0');
+        if (result > INT_MAX)
+            return 0;
+    }
+    *value = (int)result;
+    *text = p;
+    return 1;
+}
+
+/*
+ * Cut a whitespace-delimited word of at most "max" characters out
+ * of the line, terminating it in place, and step past it. Returns
+ * NULL if there is no word or it is too long.
+ */
+static char *parse_word (char **text, int max)
+{
+    char *start = skip_space (*text), *end = start;
+
+    while (*end != '\0' && !isspace ((unsigned char)*end))
+        end++;
+    if (end == start || end - start > max)
+        return NULL;
+    *text = *end == '\0' ? end : end + 1;
+    *end = '\0';
+    return start;
+}
+
+/*
+ * A type made only of digits is a number, written without leading
+ * zeros, so that "T03" and "T3" are the same type, as they are
+ * in the binary framing. The zeros are skipped in place.
+ */
+static char *parse_type (char *type)
+{
+    char *digit = type;
+
+    while (isdigit ((unsigned char)*digit))
+        digit++;
+    if (*digit != '\0')
+        return type;
+    while (type[0] == '0' && type[1] != '\0')
+        type++;
+    return type;
+}
+
+/*
+ * The rest of the line is the message. The line has already been
+ * trimmed, so only the leading whitespace has to be skipped.
+ */
+static char *parse_message (char *text)
+{
+    text = skip_space (text);
+    if (*text == '\0')
+        return NULL;
+    if (strlen (text) > PARSE_MESSAGE)
+        text[PARSE_MESSAGE] = '\0';
+    return text;
+}
+
+/*
+ * The part shared by Start_Alarm and Change_Alarm, after the
+ * opening parenthesis: "<id>): T<type> <duration> <message>".
+ */
+static int parse_alarm (char *text, parse_t *parse)
+{
+    if (!parse_int (&text, &parse->alarm_id)
+        || !expect (&text, "):", 2))
+        return 0;
+    text = skip_space (text);
+    if (!expect (&text, "T", 1)
+        || (parse->type = parse_word (&text, PARSE_TYPE)) == NULL)
+        return 0;
+    parse->type = parse_type (parse->type);
+    if ((parse->duration_text = parse_word (&text, PARSE_DURATION)) == NULL
+        || !duration_parse (parse->duration_text, &parse->duration))
+        return 0;
+    return (parse->message = parse_message (text)) != NULL;
+}
+
+/*
+ * The rest of a View_Alarms command, after the opening
+ * parenthesis: ")" for every alarm, or "T<type>)" for one type.
+ */
+static int parse_view (char *text, parse_t *parse)
+{
+    size_t length = strlen (text);
+
+    parse->type = NULL;
+    if (strcmp (text, ")") == 0)
+        return 1;
+    if (length < 3 || length - 2 > PARSE_TYPE
+        || text[0] != 'T' || text[length - 1] != ')')
+        return 0;
+    text[length - 1] = '\0';
+    parse->type = text + 1;
+    while (*++text != '\0')
+        if (isspace ((unsigned char)*text))
+            return 0;
+    parse->type = parse_type (parse->type);
+    return 1;
+}
+
+/*
+ * Parse one line, which is modified in place. The fields of
+ * "parse" that the command does not use are left alone.
+ */
+parse_kind_t parse_line (char *line, parse_t *parse)
+{
+    char *text = skip_space (line), *end;
+    int ok;
+
+    parse->type_id = -1;
+
+    /*
+     * Trim trailing whitespace, including the newline.
+     */
+    end = text + strlen (text);
+    while (end > text && isspace ((unsigned char)end[-1]))
+        end--;
+    *end = '\0';
+    if (*text == '\0')
+        return parse->kind = PARSE_EMPTY;
+
+    /*
+     * Dispatch on the keyword. Anything that is not a command is
+     * taken to be a legacy alarm.
+     */
+    if (expect (&text, "Start_Alarm(", 12)) {
+        parse->kind = PARSE_START;
+        ok = parse_alarm (text, parse);
+    } else if (expect (&text, "Change_Alarm(", 13)) {
+        parse->kind = PARSE_CHANGE;
+        ok = parse_alarm (text, parse);
+    } else if (expect (&text, "Cancel_Alarm(", 13)) {
+        parse->kind = PARSE_CANCEL;
+        ok = parse_int (&text, &parse->alarm_id) && strcmp (text, ")") == 0;
+    } else if (expect (&text, "View_Alarms(", 12)) {
+        parse->kind = PARSE_VIEW;
+        ok = parse_view (text, parse);
+    } else if (strcmp (text, "Begin_Batch()") == 0) {
+        parse->kind = PARSE_BEGIN;
+        ok = 1;
+    } else if (strcmp (text, "Commit_Batch()") == 0) {
+        parse->kind = PARSE_COMMIT;
+        ok = 1;
+    } else if (strcmp (text, "Stats()") == 0) {
+        parse->kind = PARSE_STATS;
+        ok = 1;
+    } else {
+        parse->kind = PARSE_LEGACY;
+        ok = (parse->duration_text = parse_word (&text, PARSE_DURATION)) != NULL
+            && duration_parse (parse->duration_text, &parse->duration)
+            && (parse->message = parse_message (text)) != NULL;
+    }
+    if (!ok)
+        parse->kind = PARSE_BAD;
+    return parse->kind;
+}
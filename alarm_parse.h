@@ -0,0 +1,56 @@
+#ifndef __alarm_parse_h
+#define __alarm_parse_h
+
+#include "alarm.h"
+
+/*
+ * Command line parser. parse_line looks at the command keyword
+ * once and parses the rest of the line in a single pass, in place:
+ * it writes NUL terminators into the line and points the fields
+ * of the result at the pieces, so nothing is copied or allocated.
+ * The line must stay untouched for as long as the result is used.
+ *
+ *  Start_Alarm(<id>): T<type> <duration> <message>
+ *  Change_Alarm(<id>): T<type> <duration> <message>
+ *  Cancel_Alarm(<id>)
+ *  View_Alarms()
+ *  View_Alarms(T<type>)                    (only alarms of that type)
+ *  Begin_Batch()
+ *  Commit_Batch()
+ *  Stats()                                 (lock statistics)
+ *  <duration> <message>                    (legacy alarm)
+ *
+ * An <id> is a decimal number from 0 to INT_MAX, with no sign;
+ * -1 is the alarm_id that marks a legacy alarm. A <type> made of
+ * digits is a number: its leading zeros are dropped, so T03 is
+ * type "3", the same as T3. Whitespace around
+ * the line and between fields is ignored. A
+ * message longer than PARSE_MESSAGE characters is cut short, as
+ * it would not fit in alarm_t; a type longer than PARSE_TYPE or a
+ * duration longer than PARSE_DURATION characters makes the line
+ * bad. parse_line always sets type_id to -1.
+ */
+#define PARSE_TYPE      64
+#define PARSE_DURATION  31
+#define PARSE_MESSAGE   63
+
+typedef enum parse_kind_tag {
+    PARSE_BAD, PARSE_EMPTY, PARSE_START, PARSE_CHANGE, PARSE_CANCEL,
+    PARSE_VIEW, PARSE_BEGIN, PARSE_COMMIT, PARSE_STATS, PARSE_LEGACY
+} parse_kind_t;
+
+typedef struct parse_tag {
+    parse_kind_t        kind;
+    int                 alarm_id;       /* Start, Change, Cancel */
+    char                *type;          /* Start, Change; View, or NULL */
+    int                 type_id;        /* binary frames only: the type
+                                           as a number, "type" being
+                                           NULL; -1 if there is none */
+    char                *duration_text; /* as typed, e.g. "250ms" */
+    uint64_t            duration;       /* ns */
+    char                *message;
+} parse_t;
+
+extern parse_kind_t parse_line (char *line, parse_t *parse);
+
+#endif
@@ -0,0 +1,82 @@
+/*
+ * alarm_queue.c
+ *
+ * Lock-free MPSC command queue. See alarm_queue.h.
+ */
+#include "alarm_queue.h"
+
+void queue_init (command_queue_t *queue)
+{
+    int i;
+
+    queue->tail = 0;
+    queue->head = 0;
+    for (i = 0; i < QUEUE_SIZE; i++)
+        queue->cells[i].sequence = i;
+}
+
+/*
+ * Add a command. Returns 0 if the queue is full.
+ */
+int queue_push (command_queue_t *queue, const command_t *command)
+{
+    queue_cell_t *cell;
+    uint64_t ticket, sequence;
+
+    ticket = __atomic_load_n (&queue->tail, __ATOMIC_RELAXED);
+    while (1) {
+        cell = &queue->cells[ticket & (QUEUE_SIZE - 1)];
+        sequence = __atomic_load_n (&cell->sequence, __ATOMIC_ACQUIRE);
+        if (sequence == ticket) {
+            /*
+             * The cell is free; claim it. On failure "ticket" is
+             * reloaded with the tail another producer moved on to.
+             */
+            if (__atomic_compare_exchange_n (&queue->tail, &ticket,
+                ticket + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (sequence < ticket) {
+            /*
+             * The consumer has not emptied this cell since the
+             * last time round the ring.
+             */
+            return 0;
+        } else {
+            ticket = __atomic_load_n (&queue->tail, __ATOMIC_RELAXED);
+        }
+    }
+    cell->command = *command;
+    __atomic_store_n (&cell->sequence, ticket + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/*
+ * Take the oldest command. Returns 0 if the queue is empty (or
+ * the oldest command is still being written). Only one thread
+ * may pop at a time.
+ */
+int queue_pop (command_queue_t *queue, command_t *command)
+{
+    queue_cell_t *cell;
+    uint64_t head = queue->head;
+
+    cell = &queue->cells[head & (QUEUE_SIZE - 1)];
+    if (__atomic_load_n (&cell->sequence, __ATOMIC_ACQUIRE) != head + 1)
+        return 0;
+    *command = cell->command;
+    __atomic_store_n (&cell->sequence, head + QUEUE_SIZE, __ATOMIC_RELEASE);
+    queue->head = head + 1;
+    return 1;
+}
+
+/*
+ * Is there nothing for the consumer to pop? Like queue_pop, this
+ * may only be called by the consumer.
+ */
+int queue_empty (command_queue_t *queue)
+{
+    uint64_t head = queue->head;
+
+    return __atomic_load_n (&queue->cells[head & (QUEUE_SIZE - 1)].sequence,
+        __ATOMIC_ACQUIRE) != head + 1;
+}
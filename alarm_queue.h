@@ -0,0 +1,61 @@
+#ifndef __alarm_queue_h
+#define __alarm_queue_h
+
+#include "alarm.h"
+
+/*
+ * A bounded lock-free multi-producer, single-consumer queue of
+ * commands. Any thread may push a command without taking a lock;
+ * only one thread at a time may pop (for a shard, whichever thread
+ * holds the shard mutex).
+ *
+ * The queue is a ring of QUEUE_SIZE cells, each carrying a
+ * sequence number that says whose turn it is: a producer may fill
+ * cell i when its sequence equals the ticket i it claimed, and the
+ * consumer may empty it once the sequence has moved on to i + 1.
+ * Producers claim tickets with a compare-and-swap on "tail"; the
+ * consumer owns "head" outright. A full queue makes queue_push
+ * fail rather than wait, so the caller decides how to back off.
+ *
+ * A command carries an alarm allocated and filled in by the
+ * producer: the new alarm for CMD_START, a carrier for the new
+ * fields for CMD_CHANGE, and nothing for CMD_CANCEL.
+ */
+#define QUEUE_SIZE      1024        /* cells; a power of two */
+#define QUEUE_LINE      64          /* cache line size */
+
+typedef enum command_op_tag {
+    CMD_START, CMD_CHANGE, CMD_CANCEL
+} command_op_t;
+
+typedef struct command_tag {
+    command_op_t        op;
+    int                 alarm_id;
+    alarm_t             *alarm;
+    int                 echo;       /* report a successful Start */
+} command_t;
+
+typedef struct queue_cell_tag {
+    uint64_t            sequence;
+    command_t           command;
+} queue_cell_t;
+
+/*
+ * head and tail sit on cache lines of their own, so the consumer
+ * and the producers do not invalidate each other's line on every
+ * operation.
+ */
+typedef struct command_queue_tag {
+    uint64_t            tail;       /* next ticket for producers */
+    char                pad1[QUEUE_LINE - sizeof (uint64_t)];
+    uint64_t            head;       /* next cell for the consumer */
+    char                pad2[QUEUE_LINE - sizeof (uint64_t)];
+    queue_cell_t        cells[QUEUE_SIZE];
+} command_queue_t;
+
+extern void queue_init (command_queue_t *queue);
+extern int queue_push (command_queue_t *queue, const command_t *command);
+extern int queue_pop (command_queue_t *queue, command_t *command);
+extern int queue_empty (command_queue_t *queue);
+
+#endif
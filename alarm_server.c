@@ -0,0 +1,334 @@
+/*
+ * alarm_server.c
+ *
+ * Unix domain socket command server. See alarm_server.h.
+ */
+#define _GNU_SOURCE                     /* for accept4 */
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "errors.h"
+#include "alarm_server.h"
+#include "alarm_binary.h"
+
+#define SERVER_EVENTS   64
+
+static const char ack_ok[] = "OK\n";
+static const char ack_bad[] = "Bad command\n";
+
+/*
+ * One client connection. Commands are read into "input" and
+ * replies and acknowledgements collected in "output" until they
+ * can be sent. "output" holds "size" bytes: SERVER_BUFFER, or more
+ * while a large reply is waiting to go.
+ */
+typedef struct connection_tag {
+    int                 fd;
+    size_t              have;       /* bytes in input */
+    size_t              sent;       /* bytes of output already sent */
+    size_t              pending;    /* bytes in output */
+    size_t              size;       /* bytes output can hold */
+    int                 writing;    /* waiting for room to send */
+    void                *context;   /* the handler's */
+    char                *output;
+    char                input[SERVER_BUFFER];
+} connection_t;
+
+static struct server_tag {
+    int                 listenfd;
+    int                 epollfd;
+    int                 binary;
+    server_handler_t    handler;
+    server_release_t    release;
+    pthread_t           thread;
+    connection_t        *current;   /* whose command is running */
+} server;
+
+static void watch (connection_t *connection, int op, uint32_t events)
+{
+    struct epoll_event event;
+
+    event.events = events;
+    event.data.ptr = connection;
+    if (epoll_ctl (server.epollfd, op, connection->fd, &event) < 0)
+        errno_abort ("Watch connection");
+}
+
+static void connection_close (connection_t *connection)
+{
+    close (connection->fd);     /* also removes it from epoll */
+    if (connection->context != NULL)
+        server.release (connection->context);
+    free (connection->output);
+    free (connection);
+}
+
+/*
+ * Add "size" bytes to the output, growing it if they do not fit.
+ */
+static void connection_append (connection_t *connection,
+    const char *text, size_t size)
+{
+    char *output;
+
+    if (connection->pending + size > connection->size) {
+        while (connection->pending + size > connection->size)
+            connection->size *= 2;
+        output = (char*)realloc (connection->output, connection->size);
+        if (output == NULL)
+            errno_abort ("Grow connection output");
+        connection->output = output;
+    }
+    memcpy (connection->output + connection->pending, text, size);
+    connection->pending += size;
+}
+
+static void acknowledge (connection_t *connection, const char *ack, size_t size)
+{
+    connection_append (connection, ack, size);
+}
+
+void server_reply (const char *text, size_t length)
+{
+    connection_append (server.current, text, length);
+}
+
+/*
+ * Send whatever acknowledgements are pending. Returns 1 if they
+ * have all gone, 0 if the socket is full, -1 if the client has
+ * gone away.
+ */
+static int connection_flush (connection_t *connection)
+{
+    ssize_t written;
+
+    while (connection->sent < connection->pending) {
+        written = send (connection->fd,
+            connection->output + connection->sent,
+            connection->pending - connection->sent, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            return -1;
+        }
+        connection->sent += written;
+    }
+    connection->sent = connection->pending = 0;
+
+    // let go of the room a large reply took
+    if (connection->size > SERVER_BUFFER) {
+        free (connection->output);
+        connection->size = SERVER_BUFFER;
+        connection->output = (char*)malloc (connection->size);
+        if (connection->output == NULL)
+            errno_abort ("Allocate connection output");
+    }
+    return 1;
+}
+
+/*
+ * Run every complete command in the input buffer, and keep any
+ * partial one for next time. Stops early, returning 1, once
+ * SERVER_BUFFER bytes of output are waiting, so that a client
+ * that does not read cannot make it grow without end.
+ */
+static int connection_run (connection_t *connection)
+{
+    binary_command_t command;
+    parse_t parse, *parsed;
+    char *start, *newline;
+    size_t offset = 0;
+    int used, ok, full = 0;
+
+    while (1) {
+        if (connection->pending + sizeof (ack_bad) > SERVER_BUFFER) {
+            full = 1;
+            break;
+        }
+        start = connection->input + offset;
+        if (server.binary) {
+            used = binary_decode ((unsigned char*)start,
+                connection->have - offset, &command);
+            if (used == 0)
+                break;
+            parsed = &command.parse;
+        } else {
+            newline = memchr (start, '\n', connection->have - offset);
+            if (newline == NULL)
+                break;
+            *newline = '\0';
+            used = newline + 1 - start;
+            parsed = &parse;
+            if (parse_line (start, parsed) == PARSE_EMPTY) {
+                offset += used;
+                continue;
+            }
+        }
+        offset += used;
+        server.current = connection;
+        ok = parsed->kind != PARSE_BAD && server.handler (parsed, &connection->context);
+        if (ok)
+            acknowledge (connection, ack_ok, sizeof (ack_ok) - 1);
+        else
+            acknowledge (connection, ack_bad, sizeof (ack_bad) - 1);
+    }
+    memmove (connection->input, connection->input + offset,
+        connection->have - offset);
+    connection->have -= offset;
+
+    /*
+     * A line that fills the whole buffer can never be completed;
+     * throw it away.
+     */
+    if (!full && connection->have == SERVER_BUFFER) {
+        connection->have = 0;
+        acknowledge (connection, ack_bad, sizeof (ack_bad) - 1);
+    }
+    return full;
+}
+
+/*
+ * Run what the client has sent, send the acknowledgements and
+ * read some more, until the client has nothing more to say for
+ * now. If the client is not taking its acknowledgements, stop
+ * reading from it and wait for room to send them instead.
+ */
+static void connection_event (connection_t *connection)
+{
+    ssize_t got;
+    int full, status;
+
+    while (1) {
+        full = connection_run (connection);
+        status = connection_flush (connection);
+        if (status < 0)
+            break;
+        if (status == 0) {
+            if (!connection->writing)
+                watch (connection, EPOLL_CTL_MOD, EPOLLOUT);
+            connection->writing = 1;
+            return;
+        }
+        if (full)
+            continue;
+        got = recv (connection->fd, connection->input + connection->have,
+            SERVER_BUFFER - connection->have, 0);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (connection->writing)
+                watch (connection, EPOLL_CTL_MOD, EPOLLIN);
+            connection->writing = 0;
+            return;
+        }
+        if (got <= 0)
+            break;
+        connection->have += got;
+    }
+    connection_close (connection);
+}
+
+static void server_accept (void)
+{
+    connection_t *connection;
+    int fd;
+
+    while ((fd = accept4 (server.listenfd, NULL, NULL,
+        SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        connection = (connection_t*)malloc (sizeof (connection_t));
+        if (connection == NULL)
+            errno_abort ("Allocate connection");
+        connection->output = (char*)malloc (SERVER_BUFFER);
+        if (connection->output == NULL)
+            errno_abort ("Allocate connection output");
+        connection->fd = fd;
+        connection->have = connection->sent = connection->pending = 0;
+        connection->size = SERVER_BUFFER;
+        connection->writing = 0;
+        connection->context = NULL;
+        watch (connection, EPOLL_CTL_ADD, EPOLLIN);
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR
+        && errno != ECONNABORTED)
+        errno_abort ("Accept connection");
+}
+
+static void *server_thread (void *arg)
+{
+    struct epoll_event events[SERVER_EVENTS];
+    int count, i;
+
+    (void)arg;                  // there is only the one server
+    while (1) {
+        count = epoll_wait (server.epollfd, events, SERVER_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            errno_abort ("Wait on epoll");
+        }
+        for (i = 0; i < count; i++) {
+            if (events[i].data.ptr == NULL)
+                server_accept ();
+            else
+                connection_event (events[i].data.ptr);
+        }
+    }
+    return NULL;
+}
+
+static void server_unlink (void)
+{
+    struct sockaddr_un address;
+    socklen_t length = sizeof (address);
+
+    if (getsockname (server.listenfd, (struct sockaddr*)&address, &length) == 0)
+        unlink (address.sun_path);
+}
+
+/*
+ * Listen on "path", replacing any socket left there by an earlier
+ * run, and start the server thread. The socket is removed when
+ * the program exits.
+ */
+void server_start (const char *path, int binary,
+    server_handler_t handler, server_release_t release)
+{
+    struct sockaddr_un address;
+    struct epoll_event event;
+    int status;
+
+    if (strlen (path) >= sizeof (address.sun_path)) {
+        fprintf (stderr, "Socket path \"%s\" is too long\n", path);
+        exit (1);
+    }
+    memset (&address, 0, sizeof (address));
+    address.sun_family = AF_UNIX;
+    strcpy (address.sun_path, path);
+    server.listenfd = socket (AF_UNIX,
+        SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server.listenfd < 0)
+        errno_abort ("Create socket");
+    unlink (path);
+    if (bind (server.listenfd, (struct sockaddr*)&address, sizeof (address)) < 0)
+        errno_abort ("Bind socket");
+    if (listen (server.listenfd, SOMAXCONN) < 0)
+        errno_abort ("Listen on socket");
+    atexit (server_unlink);
+
+    server.epollfd = epoll_create1 (EPOLL_CLOEXEC);
+    if (server.epollfd < 0)
+        errno_abort ("Create epoll");
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;      /* the listening socket */
+    if (epoll_ctl (server.epollfd, EPOLL_CTL_ADD, server.listenfd, &event) < 0)
+        errno_abort ("Watch socket");
+    server.binary = binary;
+    server.handler = handler;
+    server.release = release;
+    status = pthread_create (&server.thread, NULL, server_thread, NULL);
+    if (status != 0)
+        err_abort (status, "Create server thread");
+}
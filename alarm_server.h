@@ -0,0 +1,44 @@
+#ifndef __alarm_server_h
+#define __alarm_server_h
+
+#include "alarm_parse.h"
+
+/*
+ * A Unix domain socket server, so that many local clients can
+ * submit commands at once rather than funnelling them through
+ * stdin. One server thread listens on the socket and waits in
+ * epoll for new connections and for commands on the ones it has.
+ *
+ * Clients send text command lines, or binary frames if the server
+ * was started with "binary" set (see alarm_binary.h). Each
+ * command is parsed and handed to "handler", which returns 0 if
+ * it was a bad command. The client gets one acknowledgement line
+ * per command, in order: "OK" or "Bad command". Clients may send
+ * many commands without waiting for their acknowledgements; the
+ * acknowledgements for everything read in one go are sent back
+ * with a single write.
+ *
+ * A handler that has more to say than the acknowledgement (the
+ * rows of View_Alarms, say) calls server_reply, which sends
+ * "text" to the client whose command it is running, ahead of the
+ * acknowledgement. It may only be called from a handler.
+ *
+ * The handler may keep state for a connection in *context, which
+ * starts out NULL. If it is not NULL when the connection closes,
+ * it is passed to "release".
+ *
+ * A client that stops reading its acknowledgements is not read
+ * from again until they have all been sent. Replies can be any
+ * size, so a connection's output buffer grows to hold them, and
+ * goes back to SERVER_BUFFER once they have been sent.
+ */
+#define SERVER_BUFFER   (64 * 1024) /* bytes per connection and way */
+
+typedef int (*server_handler_t) (parse_t *parse, void **context);
+typedef void (*server_release_t) (void *context);
+
+extern void server_start (const char *path, int binary,
+    server_handler_t handler, server_release_t release);
+extern void server_reply (const char *text, size_t length);
+
+#endif
@@ -0,0 +1,211 @@
+/*
+ * alarm_sink.c
+ *
+ * Asynchronous output sink for alarm messages. See alarm_sink.h.
+ */
+#include <pthread.h>
+#include "errors.h"
+#include "alarm_sink.h"
+
+/*
+ * The first policy is the default.
+ */
+const char *sink_policies[] = { "block", "drop", "count", NULL };
+
+/*
+ * "head" and "tail" count bytes ever read and written, so the
+ * ring holds tail - head bytes starting at head % SINK_SIZE. The
+ * writer thread writes straight out of the ring without the
+ * mutex; producers only ever fill the free part, and the bytes it
+ * is writing do not become free until it moves head past them.
+ */
+static struct sink_tag {
+    pthread_mutex_t     mutex;
+    pthread_cond_t      data;       /* there is something to write */
+    pthread_cond_t      space;      /* the writer has made room */
+    pthread_t           thread;
+    int                 fd;
+    sink_policy_t       policy;
+    size_t              head;
+    size_t              tail;
+    unsigned long       dropped;    /* messages thrown away */
+    unsigned long       unreported; /* dropped, no notice written yet */
+    unsigned long       writes;     /* write() calls made */
+    char                buffer[SINK_SIZE];
+} sink = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+    .data = PTHREAD_COND_INITIALIZER,
+    .space = PTHREAD_COND_INITIALIZER
+};
+
+/*
+ * Copy text into the ring. Called with the mutex held, once
+ * there is room.
+ */
+static void sink_copy (const char *text, size_t length)
+{
+    size_t offset = sink.tail % SINK_SIZE, first;
+
+    first = SINK_SIZE - offset;
+    if (first > length)
+        first = length;
+    memcpy (sink.buffer + offset, text, first);
+    memcpy (sink.buffer, text + first, length - first);
+    sink.tail += length;
+}
+
+static void *sink_thread (void *arg)
+{
+    size_t offset, length;
+    ssize_t written;
+    int status;
+
+    (void)arg;                  // there is only the one sink
+    status = pthread_mutex_lock (&sink.mutex);
+    if (status != 0)
+        err_abort (status, "Lock sink");
+    while (1) {
+        while (sink.tail == sink.head) {
+            status = pthread_cond_wait (&sink.data, &sink.mutex);
+            if (status != 0)
+                err_abort (status, "Wait for sink data");
+        }
+
+        /*
+         * Write everything up to the end of the buffer or the
+         * tail, whichever comes first, in one call.
+         */
+        offset = sink.head % SINK_SIZE;
+        length = sink.tail - sink.head;
+        if (length > SINK_SIZE - offset)
+            length = SINK_SIZE - offset;
+        status = pthread_mutex_unlock (&sink.mutex);
+        if (status != 0)
+            err_abort (status, "Unlock sink");
+        do {
+            sink.writes++;
+            written = write (sink.fd, sink.buffer + offset, length);
+        } while (written < 0 && errno == EINTR);
+        if (written < 0)
+            errno_abort ("Write alarm output");
+        status = pthread_mutex_lock (&sink.mutex);
+        if (status != 0)
+            err_abort (status, "Lock sink");
+        sink.head += written;
+        status = pthread_cond_broadcast (&sink.space);
+        if (status != 0)
+            err_abort (status, "Signal sink space");
+    }
+    return NULL;
+}
+
+/*
+ * Find the policy called "name" (the default if it is NULL).
+ * Returns 0 if there is no such policy.
+ */
+int sink_policy (const char *name, sink_policy_t *policy)
+{
+    int i;
+
+    for (i = 0; sink_policies[i] != NULL; i++)
+        if (name == NULL || strcmp (name, sink_policies[i]) == 0) {
+            *policy = (sink_policy_t)i;
+            return 1;
+        }
+    return 0;
+}
+
+/*
+ * Start the sink, writing to "fd", with the policy called
+ * "policy" (or the default if it is NULL). Returns 0 if there is
+ * no such policy.
+ */
+int sink_init (int fd, const char *policy)
+{
+    int status;
+
+    if (!sink_policy (policy, &sink.policy))
+        return 0;
+    sink.fd = fd;
+    status = pthread_create (&sink.thread, NULL, sink_thread, NULL);
+    if (status != 0)
+        err_abort (status, "Create sink thread");
+    return 1;
+}
+
+/*
+ * Append "length" bytes holding "messages" complete messages,
+ * which are kept or dropped together. Text that holds no messages
+ * at all (echo, a prompt, View rows) is never dropped: it waits
+ * for room whatever the policy. "length" must be well under
+ * SINK_SIZE.
+ */
+void sink_write (const char *text, size_t length, int messages)
+{
+    char notice[64];
+    int status, notice_length = 0;
+
+    status = pthread_mutex_lock (&sink.mutex);
+    if (status != 0)
+        err_abort (status, "Lock sink");
+    if (sink.unreported != 0)
+        notice_length = snprintf (notice, sizeof (notice),
+            "(%lu alarm messages dropped)\n", sink.unreported);
+    while (SINK_SIZE - (sink.tail - sink.head) < length + notice_length) {
+        if (sink.policy != SINK_BLOCK && messages != 0) {
+            sink.dropped += messages;
+            if (sink.policy == SINK_COUNT)
+                sink.unreported += messages;
+            status = pthread_mutex_unlock (&sink.mutex);
+            if (status != 0)
+                err_abort (status, "Unlock sink");
+            return;
+        }
+        status = pthread_cond_wait (&sink.space, &sink.mutex);
+        if (status != 0)
+            err_abort (status, "Wait for sink space");
+    }
+    if (notice_length != 0) {
+        sink_copy (notice, notice_length);
+        sink.unreported = 0;
+    }
+    sink_copy (text, length);
+    status = pthread_cond_signal (&sink.data);
+    if (status != 0)
+        err_abort (status, "Signal sink data");
+    status = pthread_mutex_unlock (&sink.mutex);
+    if (status != 0)
+        err_abort (status, "Unlock sink");
+}
+
+/*
+ * Wait until everything appended so far has been written, and
+ * report any messages that were dropped. Registered with atexit.
+ */
+void sink_close (void)
+{
+    int status;
+
+    status = pthread_mutex_lock (&sink.mutex);
+    if (status != 0)
+        err_abort (status, "Lock sink");
+    while (sink.tail != sink.head) {
+        status = pthread_cond_wait (&sink.space, &sink.mutex);
+        if (status != 0)
+            err_abort (status, "Wait for sink");
+    }
+    if (sink.dropped != 0)
+        fprintf (stderr, "%lu alarm messages dropped\n", sink.dropped);
+    status = pthread_mutex_unlock (&sink.mutex);
+    if (status != 0)
+        err_abort (status, "Unlock sink");
+}
+
+/*
+ * The number of write() calls the writer thread has made. Only
+ * exact once sink_close has returned.
+ */
+unsigned long sink_writes (void)
+{
+    return sink.writes;
+}
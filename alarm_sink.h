@@ -0,0 +1,43 @@
+#ifndef __alarm_sink_h
+#define __alarm_sink_h
+
+#include <stddef.h>
+
+/*
+ * The output sink takes the alarm messages off the alarm threads.
+ * They append text to a ring buffer, and a writer thread of the
+ * sink's own empties it with large write() calls, so a slow
+ * terminal or pipe only holds up the writer and never delays
+ * expiry. The program's other output to stdout (command echo,
+ * prompts, View rows) is written through the sink as well, so
+ * that the writer thread is the only thing writing to its fd.
+ *
+ * The policy, chosen by name at startup, says what happens when
+ * the ring is too full to take a message:
+ *
+ *  block   the alarm thread waits for the writer to make room
+ *  drop    the message is thrown away; the number dropped is
+ *          reported on stderr when the sink is closed
+ *  count   as for drop, but once there is room again a line
+ *          saying how many messages were lost is written in
+ *          their place
+ *
+ * sink_policy only looks a policy up by name, for output that is
+ * written some other way (the single-threaded loops write their
+ * own, with no sink thread).
+ */
+#define SINK_SIZE       (1024 * 1024)   /* bytes in the ring */
+
+typedef enum sink_policy_tag {
+    SINK_BLOCK, SINK_DROP, SINK_COUNT
+} sink_policy_t;
+
+extern const char *sink_policies[];
+
+extern int sink_policy (const char *name, sink_policy_t *policy);
+extern int sink_init (int fd, const char *policy);
+extern void sink_write (const char *text, size_t length, int messages);
+extern void sink_close (void);
+extern unsigned long sink_writes (void);
+
+#endif
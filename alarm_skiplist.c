@@ -0,0 +1,392 @@
+/*
+ * alarm_skiplist.c
+ *
+ * Lock-free skip list alarm store. See alarm_skiplist.h.
+ */
+#include <stdint.h>
+#include "errors.h"
+#include "alarm_skiplist.h"
+
+typedef struct skip_node_tag {
+    uint64_t            time;       /* the key, copied from the alarm */
+    int                 alarm_id;
+    alarm_t             *alarm;
+    int                 levels;
+    int                 refs;       /* inserter and remover */
+    struct skip_node_tag *retired;  /* next in a limbo list */
+    struct skip_node_tag *next[];   /* "levels" of them */
+} skip_node_t;
+
+#define MARKED(p)       (((uintptr_t)(p) & 1) != 0)
+#define MARK(p)         ((skip_node_t*)((uintptr_t)(p) | 1))
+#define UNMARK(p)       ((skip_node_t*)((uintptr_t)(p) & ~(uintptr_t)1))
+
+#define LOAD(p)         __atomic_load_n ((p), __ATOMIC_ACQUIRE)
+#define CAS(p,old,new)  __atomic_compare_exchange_n ((p), (old), (new), \
+                            0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+
+/*
+ * Epochs. A thread announces the global epoch it saw in its
+ * record while it is inside an operation. The global epoch only
+ * moves on once every active thread has seen the current one, so
+ * a node retired in epoch e is unreachable to everyone by epoch
+ * e + 2. Each record keeps the nodes it retired in three limbo
+ * lists, one per epoch modulo 3, each tagged with its epoch.
+ */
+#define EPOCH_BATCH     64          /* retirements between advances */
+
+typedef struct epoch_record_tag {
+    struct epoch_record_tag *next;
+    unsigned long       epoch;
+    int                 active;
+    skip_node_t         *limbo[3];
+    unsigned long       limbo_epoch[3];
+    int                 retired;    /* since the last try to advance */
+    uint32_t            random;     /* for node levels */
+} epoch_record_t;
+
+static unsigned long epoch_global = 2;
+static epoch_record_t *epoch_records;
+static __thread epoch_record_t *epoch_mine;
+
+static epoch_record_t *epoch_record (void)
+{
+    epoch_record_t *record = epoch_mine;
+
+    if (record != NULL)
+        return record;
+    record = (epoch_record_t*)calloc (1, sizeof (epoch_record_t));
+    if (record == NULL)
+        errno_abort ("Allocate epoch record");
+    record->random = (uint32_t)(uintptr_t)record | 1;
+    record->next = __atomic_load_n (&epoch_records, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n (&epoch_records, &record->next,
+        record, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    epoch_mine = record;
+    return record;
+}
+
+static epoch_record_t *epoch_enter (void)
+{
+    epoch_record_t *record = epoch_record ();
+
+    __atomic_store_n (&record->epoch,
+        __atomic_load_n (&epoch_global, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+    __atomic_store_n (&record->active, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence (__ATOMIC_SEQ_CST);
+    return record;
+}
+
+static void epoch_leave (epoch_record_t *record)
+{
+    __atomic_store_n (&record->active, 0, __ATOMIC_RELEASE);
+}
+
+static void limbo_free (epoch_record_t *record, int index)
+{
+    skip_node_t *node, *next;
+
+    for (node = record->limbo[index]; node != NULL; node = next) {
+        next = node->retired;
+        free (node);
+    }
+    record->limbo[index] = NULL;
+}
+
+/*
+ * Move the global epoch on if every active thread has seen it,
+ * and free whatever of ours is now two epochs old.
+ */
+static void epoch_advance (epoch_record_t *record)
+{
+    epoch_record_t *other;
+    unsigned long epoch = __atomic_load_n (&epoch_global, __ATOMIC_ACQUIRE);
+    int i;
+
+    for (other = __atomic_load_n (&epoch_records, __ATOMIC_ACQUIRE);
+        other != NULL; other = other->next)
+        if (__atomic_load_n (&other->active, __ATOMIC_ACQUIRE)
+            && __atomic_load_n (&other->epoch, __ATOMIC_ACQUIRE) != epoch)
+            return;
+    __atomic_compare_exchange_n (&epoch_global, &epoch, epoch + 1, 0,
+        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    epoch = __atomic_load_n (&epoch_global, __ATOMIC_ACQUIRE);
+    for (i = 0; i < 3; i++)
+        if (record->limbo[i] != NULL && record->limbo_epoch[i] + 2 <= epoch)
+            limbo_free (record, i);
+}
+
+/*
+ * Hand over an unlinked node to be freed once nobody can see it.
+ * It is tagged with the global epoch, not the (possibly older)
+ * one we entered in, as threads that entered since may have seen
+ * it. The list for this epoch last held nodes from three epochs
+ * ago, if anything, which are safe to free now.
+ */
+static void epoch_retire (epoch_record_t *record, skip_node_t *node)
+{
+    unsigned long epoch = __atomic_load_n (&epoch_global, __ATOMIC_ACQUIRE);
+    int index = epoch % 3;
+
+    if (record->limbo_epoch[index] != epoch) {
+        limbo_free (record, index);
+        record->limbo_epoch[index] = epoch;
+    }
+    node->retired = record->limbo[index];
+    record->limbo[index] = node;
+    if (++record->retired >= EPOCH_BATCH) {
+        record->retired = 0;
+        epoch_advance (record);
+    }
+}
+
+static void node_release (epoch_record_t *record, skip_node_t *node)
+{
+    if (__atomic_sub_fetch (&node->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        epoch_retire (record, node);
+}
+
+/*
+ * Does "node" come before "key"? Legacy alarms all have the
+ * alarm_id -1, so alarms with the same time and alarm_id are
+ * told apart by address.
+ */
+static int node_before (const skip_node_t *node, const skip_node_t *key)
+{
+    if (node->time != key->time)
+        return node->time < key->time;
+    if (node->alarm_id != key->alarm_id)
+        return node->alarm_id < key->alarm_id;
+    return (uintptr_t)node->alarm < (uintptr_t)key->alarm;
+}
+
+/*
+ * Find, at every level, the last node before "key" (preds) and
+ * the first node not before it (succs), unlinking any marked
+ * nodes on the way. If a compare-and-swap finds the list changed
+ * under it, start again from the top.
+ */
+static void skip_find (skiplist_t *list, const skip_node_t *key,
+    skip_node_t **preds, skip_node_t **succs)
+{
+    skip_node_t *pred, *curr, *succ, *expected;
+    int level;
+
+retry:
+    pred = list->head;
+    for (level = SKIP_LEVELS - 1; level >= 0; level--) {
+        curr = UNMARK (LOAD (&pred->next[level]));
+        while (curr != NULL) {
+            succ = LOAD (&curr->next[level]);
+            if (MARKED (succ)) {
+                expected = curr;
+                if (!CAS (&pred->next[level], &expected, UNMARK (succ)))
+                    goto retry;
+                curr = UNMARK (succ);
+                continue;
+            }
+            if (!node_before (curr, key))
+                break;
+            pred = curr;
+            curr = succ;
+        }
+        preds[level] = pred;
+        succs[level] = curr;
+    }
+}
+
+/*
+ * Levels are 1 + the number of times in a row a 1 in 4 chance
+ * comes up, from the thread's own xorshift generator.
+ */
+static int skip_levels (epoch_record_t *record)
+{
+    uint32_t x = record->random;
+    int levels = 1;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    record->random = x;
+    while (levels < SKIP_LEVELS && (x & 3) == 0) {
+        levels++;
+        x >>= 2;
+    }
+    return levels;
+}
+
+void skip_init (skiplist_t *list)
+{
+    list->head = (skip_node_t*)calloc (1,
+        sizeof (skip_node_t) + SKIP_LEVELS * sizeof (skip_node_t*));
+    if (list->head == NULL)
+        errno_abort ("Allocate skip list");
+    list->head->levels = SKIP_LEVELS;
+    list->count = 0;
+}
+
+void skip_insert (skiplist_t *list, alarm_t *alarm)
+{
+    skip_node_t *preds[SKIP_LEVELS], *succs[SKIP_LEVELS];
+    skip_node_t *node, *expected, *next;
+    epoch_record_t *record = epoch_enter ();
+    int levels = skip_levels (record), level;
+
+    node = (skip_node_t*)malloc (
+        sizeof (skip_node_t) + levels * sizeof (skip_node_t*));
+    if (node == NULL)
+        errno_abort ("Allocate skip node");
+    node->time = alarm->time;
+    node->alarm_id = alarm->alarm_id;
+    node->alarm = alarm;
+    node->levels = levels;
+    node->refs = 2;
+    alarm->node = node;
+
+    /*
+     * The node is in the list once it is linked at level 0.
+     */
+    do {
+        skip_find (list, node, preds, succs);
+        for (level = 0; level < levels; level++)
+            __atomic_store_n (&node->next[level], succs[level],
+                __ATOMIC_RELAXED);
+        expected = succs[0];
+    } while (!CAS (&preds[0]->next[0], &expected, node));
+    __atomic_add_fetch (&list->count, 1, __ATOMIC_RELAXED);
+
+    /*
+     * Link the upper levels, unless the node is removed meanwhile:
+     * once a level is marked, stop.
+     */
+    for (level = 1; level < levels; level++) {
+        while (1) {
+            expected = succs[level];
+            if (CAS (&preds[level]->next[level], &expected, node))
+                break;
+            skip_find (list, node, preds, succs);
+            next = LOAD (&node->next[level]);
+            if (MARKED (next))
+                goto linked;
+            if (next != succs[level]
+                && !CAS (&node->next[level], &next, succs[level]))
+                goto linked;
+        }
+    }
+linked:
+
+    /*
+     * If it was removed while we were linking it, we may have
+     * linked a level after the remover unlinked it; unlink it
+     * again before letting go.
+     */
+    if (MARKED (LOAD (&node->next[0])))
+        skip_find (list, node, preds, succs);
+    node_release (record, node);
+    epoch_leave (record);
+}
+
+/*
+ * Mark every level of "node", top first. Returns 1 if this thread
+ * marked level 0, and so removed it; then unlink it.
+ */
+static int skip_unlink (skiplist_t *list, skip_node_t *node,
+    epoch_record_t *record)
+{
+    skip_node_t *preds[SKIP_LEVELS], *succs[SKIP_LEVELS], *next;
+    int level;
+
+    for (level = node->levels - 1; level >= 1; level--) {
+        next = LOAD (&node->next[level]);
+        while (!MARKED (next) && !CAS (&node->next[level], &next, MARK (next)))
+            ;
+    }
+    next = LOAD (&node->next[0]);
+    do {
+        if (MARKED (next))
+            return 0;
+    } while (!CAS (&node->next[0], &next, MARK (next)));
+    __atomic_sub_fetch (&list->count, 1, __ATOMIC_RELAXED);
+    skip_find (list, node, preds, succs);
+    node_release (record, node);
+    return 1;
+}
+
+/*
+ * Remove an alarm that was inserted and has not been freed.
+ * Returns 0 if another thread removed it first.
+ */
+int skip_remove (skiplist_t *list, alarm_t *alarm)
+{
+    epoch_record_t *record = epoch_enter ();
+    int removed;
+
+    removed = skip_unlink (list, (skip_node_t*)alarm->node, record);
+    epoch_leave (record);
+    return removed;
+}
+
+/*
+ * The first node at level 0 that is not being removed.
+ */
+static skip_node_t *skip_first (skiplist_t *list)
+{
+    skip_node_t *node = UNMARK (LOAD (&list->head->next[0])), *next;
+
+    while (node != NULL && MARKED (next = LOAD (&node->next[0])))
+        node = UNMARK (next);
+    return node;
+}
+
+/*
+ * Remove every alarm that is due at "now" and return them as a
+ * list chained through alarm->link, earliest first, or NULL if
+ * none is.
+ */
+alarm_t *skip_expire (skiplist_t *list, uint64_t now)
+{
+    alarm_t *head = NULL, **tail = &head, *alarm;
+    epoch_record_t *record = epoch_enter ();
+    skip_node_t *node;
+
+    while ((node = skip_first (list)) != NULL && node->time <= now) {
+        alarm = node->alarm;
+        if (skip_unlink (list, node, record)) {
+            *tail = alarm;
+            tail = &alarm->link;
+        }
+    }
+    *tail = NULL;
+    epoch_leave (record);
+    return head;
+}
+
+int skip_next (skiplist_t *list, uint64_t *when)
+{
+    epoch_record_t *record = epoch_enter ();
+    skip_node_t *node = skip_first (list);
+
+    if (node != NULL)
+        *when = node->time;
+    epoch_leave (record);
+    return node != NULL;
+}
+
+/*
+ * Call "fn" for every alarm in the list, earliest first. "fn"
+ * must not change the list.
+ */
+void skip_foreach (
+    skiplist_t *list, void (*fn)(alarm_t *, void *), void *arg)
+{
+    epoch_record_t *record = epoch_enter ();
+    skip_node_t *node, *next;
+
+    for (node = skip_first (list); node != NULL; node = UNMARK (next)) {
+        next = LOAD (&node->next[0]);
+        if (!MARKED (next))
+            fn (node->alarm, arg);
+    }
+    epoch_leave (record);
+}
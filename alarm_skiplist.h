@@ -0,0 +1,47 @@
+#ifndef __alarm_skiplist_h
+#define __alarm_skiplist_h
+
+#include "alarm.h"
+
+/*
+ * A lock-free skip list of alarms, ordered by (time, alarm_id).
+ * Unlike the other stores, any number of threads may insert,
+ * remove and expire alarms at the same time with no mutex: every
+ * change to the list is a compare-and-swap.
+ *
+ * The alarms are not linked into the list themselves. Each one
+ * gets a node holding a copy of its key, so that a thread walking
+ * the list never touches an alarm that may already have been
+ * freed; alarm->node points back at it. A node is removed by
+ * first marking its next pointers (the low bit), top level first;
+ * whoever marks level 0 has removed the alarm, and anybody who
+ * walks past a marked node helps to unlink it. skip_remove
+ * returns 0 if some other thread (an expiry, say) got there first.
+ *
+ * Unlinked nodes are freed with epoch-based reclamation: every
+ * operation runs inside an epoch, and a node is only freed two
+ * epochs after it was retired, once no thread can still be
+ * looking at it. A node is retired only when both the thread that
+ * inserted it and the one that removed it are done with it, since
+ * the inserter may still be linking its upper levels.
+ *
+ * Each thread that uses a skip list gets a small record, kept
+ * for the life of the process; nodes a thread retires just before
+ * it exits are never freed.
+ */
+#define SKIP_LEVELS     16
+
+typedef struct skiplist_tag {
+    struct skip_node_tag *head;
+    int                 count;
+} skiplist_t;
+
+extern void skip_init (skiplist_t *list);
+extern void skip_insert (skiplist_t *list, alarm_t *alarm);
+extern int skip_remove (skiplist_t *list, alarm_t *alarm);
+extern alarm_t *skip_expire (skiplist_t *list, uint64_t now);
+extern int skip_next (skiplist_t *list, uint64_t *when);
+extern void skip_foreach (
+    skiplist_t *list, void (*fn)(alarm_t *, void *), void *arg);
+
+#endif
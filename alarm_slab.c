@@ -0,0 +1,120 @@
+/*
+ * alarm_slab.c
+ *
+ * Slab allocator for alarm_t. See alarm_slab.h. Free alarms are
+ * chained through their "link" field.
+ */
+#include <pthread.h>
+#include "errors.h"
+#include "alarm_slab.h"
+
+/*
+ * A thread's private free list.
+ */
+typedef struct slab_cache_tag {
+    alarm_t             *free;
+    int                 count;
+} slab_cache_t;
+
+static __thread slab_cache_t slab_cache;
+
+/*
+ * The shared depot holds whole batches, each a chain of
+ * SLAB_BATCH free alarms, linked together through the "prev"
+ * field of their first alarm.
+ */
+static pthread_mutex_t depot_mutex = PTHREAD_MUTEX_INITIALIZER;
+static alarm_t *depot = NULL;
+
+/*
+ * Carve a new slab into batches and add them to the depot.
+ * Called with depot_mutex locked.
+ */
+static void slab_grow (void)
+{
+    alarm_t *slab;
+    int i;
+
+    slab = (alarm_t*)malloc (SLAB_ALARMS * sizeof (alarm_t));
+    if (slab == NULL)
+        errno_abort ("Allocate slab");
+    for (i = 0; i < SLAB_ALARMS; i++)
+        slab[i].link = (i % SLAB_BATCH == SLAB_BATCH - 1)
+            ? NULL : &slab[i + 1];
+    for (i = 0; i < SLAB_ALARMS; i += SLAB_BATCH) {
+        slab[i].prev = depot;
+        depot = &slab[i];
+    }
+}
+
+/*
+ * Refill the calling thread's empty free list with one batch.
+ */
+static void slab_refill (slab_cache_t *cache)
+{
+    alarm_t *batch;
+    int status;
+
+    status = pthread_mutex_lock (&depot_mutex);
+    if (status != 0)
+        err_abort (status, "Lock depot");
+    if (depot == NULL)
+        slab_grow ();
+    batch = depot;
+    depot = batch->prev;
+    status = pthread_mutex_unlock (&depot_mutex);
+    if (status != 0)
+        err_abort (status, "Unlock depot");
+    cache->free = batch;
+    cache->count = SLAB_BATCH;
+}
+
+/*
+ * Hand one batch from the calling thread's free list back to the
+ * depot.
+ */
+static void slab_drain (slab_cache_t *cache)
+{
+    alarm_t *batch, *last;
+    int status, i;
+
+    batch = last = cache->free;
+    for (i = 1; i < SLAB_BATCH; i++)
+        last = last->link;
+    cache->free = last->link;
+    cache->count -= SLAB_BATCH;
+    last->link = NULL;
+
+    status = pthread_mutex_lock (&depot_mutex);
+    if (status != 0)
+        err_abort (status, "Lock depot");
+    batch->prev = depot;
+    depot = batch;
+    status = pthread_mutex_unlock (&depot_mutex);
+    if (status != 0)
+        err_abort (status, "Unlock depot");
+}
+
+alarm_t *alarm_alloc (void)
+{
+    slab_cache_t *cache = &slab_cache;
+    alarm_t *alarm;
+
+    if (cache->free == NULL)
+        slab_refill (cache);
+    alarm = cache->free;
+    cache->free = alarm->link;
+    cache->count--;
+    alarm->link = alarm->prev = NULL;
+    return alarm;
+}
+
+void alarm_free (alarm_t *alarm)
+{
+    slab_cache_t *cache = &slab_cache;
+
+    alarm->link = cache->free;
+    cache->free = alarm;
+    if (++cache->count > 2 * SLAB_BATCH)
+        slab_drain (cache);
+}
@@ -0,0 +1,26 @@
+#ifndef __alarm_slab_h
+#define __alarm_slab_h
+
+#include "alarm.h"
+
+/*
+ * A slab allocator for alarm_t. Alarms are carved out of large
+ * slabs and recycled through free lists instead of going back to
+ * malloc/free. Each thread keeps its own free list, so the common
+ * case takes no lock at all. A thread whose list runs dry takes a
+ * batch of SLAB_BATCH alarms from a shared depot, and a thread
+ * whose list grows past twice that returns a batch to it. New
+ * slabs are only allocated when the depot is empty too. Once the
+ * number of live alarms stops growing, nothing calls malloc or
+ * free any more.
+ *
+ * Alarms freed by one thread may be allocated by another. Slab
+ * memory is never returned to the system.
+ */
+#define SLAB_ALARMS     1024        /* alarms per slab */
+#define SLAB_BATCH      64          /* alarms moved to/from the depot */
+
+extern alarm_t *alarm_alloc (void);
+extern void alarm_free (alarm_t *alarm);
+
+#endif
@@ -0,0 +1,218 @@
+/*
+ * alarm_store.c
+ *
+ * Adapts the store backends to the common interface declared in
+ * alarm_store.h, and selects one by name.
+ */
+#include "errors.h"
+#include "alarm_store.h"
+#include "alarm_wheel.h"
+#include "alarm_heap.h"
+#include "alarm_skiplist.h"
+
+/*
+ * Timing wheel backend.
+ */
+static void *wheel_create (uint64_t now)
+{
+    wheel_t *wheel = (wheel_t*)malloc (sizeof (wheel_t));
+
+    if (wheel == NULL)
+        errno_abort ("Allocate wheel");
+    wheel_init (wheel, now);
+    return wheel;
+}
+
+static void wheel_insert_op (void *impl, alarm_t *alarm)
+{
+    wheel_insert ((wheel_t*)impl, alarm);
+}
+
+static void wheel_remove_op (void *impl, alarm_t *alarm)
+{
+    wheel_remove ((wheel_t*)impl, alarm);
+}
+
+/*
+ * A changed alarm belongs in a different slot; moving it there
+ * is just a removal and an insertion.
+ */
+static void wheel_update_op (void *impl, alarm_t *alarm)
+{
+    wheel_remove ((wheel_t*)impl, alarm);
+    wheel_insert ((wheel_t*)impl, alarm);
+}
+
+static alarm_t *wheel_expire_op (void *impl, uint64_t now)
+{
+    return wheel_expire ((wheel_t*)impl, now);
+}
+
+static int wheel_next_op (void *impl, uint64_t *when)
+{
+    return wheel_next ((wheel_t*)impl, when);
+}
+
+static int wheel_count_op (void *impl)
+{
+    return ((wheel_t*)impl)->count;
+}
+
+static void wheel_foreach_op (
+    void *impl, void (*fn)(alarm_t *, void *), void *arg)
+{
+    wheel_foreach ((wheel_t*)impl, fn, arg);
+}
+
+static const store_ops_t wheel_store_ops = {
+    "wheel", wheel_create, wheel_insert_op, wheel_remove_op,
+    wheel_update_op, wheel_expire_op, wheel_next_op, wheel_count_op,
+    wheel_foreach_op
+};
+
+/*
+ * 4-ary heap backend.
+ */
+static void *heap_create (uint64_t now)
+{
+    heap_t *heap = (heap_t*)malloc (sizeof (heap_t));
+
+    (void)now;                  // a heap has no time of its own
+    if (heap == NULL)
+        errno_abort ("Allocate heap");
+    heap_init (heap);
+    return heap;
+}
+
+static void heap_insert_op (void *impl, alarm_t *alarm)
+{
+    heap_insert ((heap_t*)impl, alarm);
+}
+
+static void heap_remove_op (void *impl, alarm_t *alarm)
+{
+    heap_remove ((heap_t*)impl, alarm);
+}
+
+static void heap_update_op (void *impl, alarm_t *alarm)
+{
+    heap_update ((heap_t*)impl, alarm);
+}
+
+static alarm_t *heap_expire_op (void *impl, uint64_t now)
+{
+    return heap_expire ((heap_t*)impl, now);
+}
+
+static int heap_next_op (void *impl, uint64_t *when)
+{
+    return heap_next ((heap_t*)impl, when);
+}
+
+static int heap_count_op (void *impl)
+{
+    return ((heap_t*)impl)->count;
+}
+
+static void heap_foreach_op (
+    void *impl, void (*fn)(alarm_t *, void *), void *arg)
+{
+    heap_foreach ((heap_t*)impl, fn, arg);
+}
+
+static const store_ops_t heap_store_ops = {
+    "heap", heap_create, heap_insert_op, heap_remove_op,
+    heap_update_op, heap_expire_op, heap_next_op, heap_count_op,
+    heap_foreach_op
+};
+
+/*
+ * Lock-free skip list backend. The shard mutex still serialises
+ * the store operations here, but the list needs none of it.
+ */
+static void *skip_create (uint64_t now)
+{
+    skiplist_t *list = (skiplist_t*)malloc (sizeof (skiplist_t));
+
+    (void)now;                  // nor has a skip list
+    if (list == NULL)
+        errno_abort ("Allocate skip list");
+    skip_init (list);
+    return list;
+}
+
+static void skip_insert_op (void *impl, alarm_t *alarm)
+{
+    skip_insert ((skiplist_t*)impl, alarm);
+}
+
+static void skip_remove_op (void *impl, alarm_t *alarm)
+{
+    skip_remove ((skiplist_t*)impl, alarm);
+}
+
+/*
+ * The node still holds the old time, so the alarm can be found
+ * and taken out under its old key and put back under the new.
+ */
+static void skip_update_op (void *impl, alarm_t *alarm)
+{
+    skip_remove ((skiplist_t*)impl, alarm);
+    skip_insert ((skiplist_t*)impl, alarm);
+}
+
+static alarm_t *skip_expire_op (void *impl, uint64_t now)
+{
+    return skip_expire ((skiplist_t*)impl, now);
+}
+
+static int skip_next_op (void *impl, uint64_t *when)
+{
+    return skip_next ((skiplist_t*)impl, when);
+}
+
+static int skip_count_op (void *impl)
+{
+    return __atomic_load_n (&((skiplist_t*)impl)->count, __ATOMIC_RELAXED);
+}
+
+static void skip_foreach_op (
+    void *impl, void (*fn)(alarm_t *, void *), void *arg)
+{
+    skip_foreach ((skiplist_t*)impl, fn, arg);
+}
+
+static const store_ops_t skip_store_ops = {
+    "skiplist", skip_create, skip_insert_op, skip_remove_op,
+    skip_update_op, skip_expire_op, skip_next_op, skip_count_op,
+    skip_foreach_op
+};
+
+/*
+ * The first backend is the default.
+ */
+const store_ops_t *store_backends[] = {
+    &wheel_store_ops,
+    &heap_store_ops,
+    &skip_store_ops,
+    NULL
+};
+
+/*
+ * Create an empty store using the backend called "name" (or the
+ * default if "name" is NULL). Returns 0 if there is no such
+ * backend.
+ */
+int store_init (alarm_store_t *store, const char *name, uint64_t now)
+{
+    int i;
+
+    for (i = 0; store_backends[i] != NULL; i++) {
+        if (name == NULL || strcmp (name, store_backends[i]->name) == 0) {
+            store->ops = store_backends[i];
+            store->impl = store->ops->create (now);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,52 @@
+#ifndef __alarm_store_h
+#define __alarm_store_h
+
+#include "alarm.h"
+
+/*
+ * The alarm store is the ordered collection of pending alarms.
+ * Several backends implement the same operations, and one is
+ * chosen by name when the program starts. None of the operations
+ * lock; the caller must hold whatever mutex protects the store.
+ *
+ *  insert      add an alarm
+ *  remove      remove an alarm that is in the store
+ *  update      reposition an alarm whose time was changed in place
+ *  expire      remove every alarm due at "now" and return them
+ *              chained through alarm->link, or NULL if none is
+ *  next        set *when to the time the store next needs
+ *              attention; returns 0 if the store is empty
+ *  count       number of alarms held
+ *  foreach     call fn for every alarm, in no particular order
+ */
+typedef struct store_ops_tag {
+    const char          *name;
+    void                *(*create) (uint64_t now);
+    void                (*insert) (void *impl, alarm_t *alarm);
+    void                (*remove) (void *impl, alarm_t *alarm);
+    void                (*update) (void *impl, alarm_t *alarm);
+    alarm_t             *(*expire) (void *impl, uint64_t now);
+    int                 (*next) (void *impl, uint64_t *when);
+    int                 (*count) (void *impl);
+    void                (*foreach) (
+        void *impl, void (*fn)(alarm_t *, void *), void *arg);
+} store_ops_t;
+
+typedef struct alarm_store_tag {
+    const store_ops_t   *ops;
+    void                *impl;
+} alarm_store_t;
+
+extern const store_ops_t *store_backends[];
+
+extern int store_init (alarm_store_t *store, const char *name, uint64_t now);
+
+#define store_insert(s,a)       ((s)->ops->insert ((s)->impl, (a)))
+#define store_remove(s,a)       ((s)->ops->remove ((s)->impl, (a)))
+#define store_update(s,a)       ((s)->ops->update ((s)->impl, (a)))
+#define store_expire(s,now)     ((s)->ops->expire ((s)->impl, (now)))
+#define store_next(s,when)      ((s)->ops->next ((s)->impl, (when)))
+#define store_count(s)          ((s)->ops->count ((s)->impl))
+#define store_foreach(s,fn,arg) ((s)->ops->foreach ((s)->impl, (fn), (arg)))
+
+#endif
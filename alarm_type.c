@@ -0,0 +1,99 @@
+/*
+ * alarm_type.c
+ *
+ * Alarm type interning. See alarm_type.h.
+ */
+#include <pthread.h>
+#include "errors.h"
+#include "alarm_type.h"
+
+/*
+ * "slots" is an open-addressing hash table, with linear probing,
+ * twice the size of the id space. Each slot holds an id + 1, or 0
+ * if it is empty. Slots and names are only ever filled in, with
+ * the mutex held, and a slot is published after the name it
+ * points to, so a reader that finds a slot also finds its name.
+ */
+#define TYPE_SLOTS      (TYPE_MAX * 2)
+
+static pthread_mutex_t type_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t type_slots[TYPE_SLOTS];
+static const char *type_names[TYPE_MAX] = { "" };
+static int type_count = 1;
+
+/*
+ * FNV-1a.
+ */
+static uint32_t type_hash (const char *name)
+{
+    uint32_t hash = 2166136261U;
+
+    while (*name != '\0')
+        hash = (hash ^ (unsigned char)*name++) * 16777619U;
+    return hash;
+}
+
+/*
+ * Look for "name", starting at its home slot. Returns its id, or
+ * -1 with *slot set to the empty slot where it would go.
+ */
+static int type_find (const char *name, uint32_t *slot)
+{
+    uint32_t i = type_hash (name) & (TYPE_SLOTS - 1), entry;
+
+    while ((entry = __atomic_load_n (&type_slots[i], __ATOMIC_ACQUIRE)) != 0) {
+        if (strcmp (type_names[entry - 1], name) == 0)
+            return entry - 1;
+        i = (i + 1) & (TYPE_SLOTS - 1);
+    }
+    *slot = i;
+    return -1;
+}
+
+int type_intern (const char *name)
+{
+    uint32_t slot;
+    char *copy;
+    int type, status;
+
+    if (*name == '\0')
+        return 0;
+    type = type_find (name, &slot);
+    if (type >= 0)
+        return type;
+
+    /*
+     * Not there: look again with the mutex held, since another
+     * thread may have added it meanwhile, and add it.
+     */
+    status = pthread_mutex_lock (&type_mutex);
+    if (status != 0)
+        err_abort (status, "Lock types");
+    type = type_find (name, &slot);
+    if (type < 0 && type_count < TYPE_MAX) {
+        copy = strdup (name);
+        if (copy == NULL)
+            errno_abort ("Copy type");
+        type = type_count++;
+        type_names[type] = copy;
+        __atomic_store_n (&type_slots[slot], type + 1, __ATOMIC_RELEASE);
+    }
+    status = pthread_mutex_unlock (&type_mutex);
+    if (status != 0)
+        err_abort (status, "Unlock types");
+    return type;
+}
+
+int type_lookup (const char *name)
+{
+    uint32_t slot;
+
+    if (*name == '\0')
+        return 0;
+    return type_find (name, &slot);
+}
+
+const char *type_name (uint16_t type)
+{
+    return type_names[type];
+}
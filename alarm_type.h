@@ -0,0 +1,27 @@
+#ifndef __alarm_type_h
+#define __alarm_type_h
+
+#include "alarm.h"
+
+/*
+ * Alarm types are interned: each distinct type string is stored
+ * once, in a global table, and an alarm carries only its small
+ * integer id. Comparing types is comparing ids, and the string is
+ * only looked up to print it.
+ *
+ * Id 0 is the empty type of legacy alarms. type_intern returns
+ * the id of "name", adding it to the table if it is new, or -1 if
+ * the table already holds TYPE_MAX types. type_lookup returns the
+ * id of "name" without adding it, or -1 if it is not there.
+ *
+ * Any thread may intern and look up types. A type, once added, is
+ * never removed or changed, so lookups take no lock; only adding
+ * a type does.
+ */
+#define TYPE_MAX        65536
+
+extern int type_intern (const char *name);
+extern int type_lookup (const char *name);
+extern const char *type_name (uint16_t type);
+
+#endif
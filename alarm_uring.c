@@ -0,0 +1,228 @@
+/*
+ * alarm_uring.c
+ *
+ * Raw io_uring for the single-threaded event loop. See
+ * alarm_uring.h.
+ */
+#include "errors.h"
+#include "alarm_uring.h"
+#ifdef HAVE_URING
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <linux/io_uring.h>
+#endif
+
+unsigned long uring_enters = 0;
+
+#ifdef HAVE_URING
+/*
+ * The ring's shared memory, and "tail", the submission queue tail
+ * as far as requests have been filled in. The kernel only sees
+ * them once uring_submit stores it into *sq_tail. "times" holds
+ * the timespec for a timeout in the slot of its request; the
+ * kernel reads it when the request is submitted.
+ */
+static struct uring_tag {
+    int                 fd;
+    unsigned int        *sq_head;
+    unsigned int        *sq_tail;
+    unsigned int        *sq_mask;
+    unsigned int        *sq_array;
+    unsigned int        *cq_head;
+    unsigned int        *cq_tail;
+    unsigned int        *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    struct __kernel_timespec *times;
+    unsigned int        tail;
+} ring;
+
+/*
+ * Set up a ring of "entries" requests. Returns 0 if the kernel
+ * will not.
+ */
+int uring_init (unsigned int entries)
+{
+    struct io_uring_params params;
+    size_t sq_size, cq_size;
+    char *sq, *cq;
+
+    memset (&params, 0, sizeof (params));
+    ring.fd = syscall (__NR_io_uring_setup, entries, &params);
+    if (ring.fd < 0)
+        return 0;
+    sq_size = params.sq_off.array + params.sq_entries * sizeof (unsigned int);
+    cq_size = params.cq_off.cqes
+        + params.cq_entries * sizeof (struct io_uring_cqe);
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) && cq_size > sq_size)
+        sq_size = cq_size;
+    sq = (char*)mmap (NULL, sq_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED)
+        errno_abort ("Map submission queue");
+    cq = sq;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        cq = (char*)mmap (NULL, cq_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED)
+            errno_abort ("Map completion queue");
+    }
+    ring.sqes = (struct io_uring_sqe*)mmap (NULL,
+        params.sq_entries * sizeof (struct io_uring_sqe),
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        ring.fd, IORING_OFF_SQES);
+    if (ring.sqes == MAP_FAILED)
+        errno_abort ("Map submission entries");
+    ring.sq_head = (unsigned int*)(sq + params.sq_off.head);
+    ring.sq_tail = (unsigned int*)(sq + params.sq_off.tail);
+    ring.sq_mask = (unsigned int*)(sq + params.sq_off.ring_mask);
+    ring.sq_array = (unsigned int*)(sq + params.sq_off.array);
+    ring.cq_head = (unsigned int*)(cq + params.cq_off.head);
+    ring.cq_tail = (unsigned int*)(cq + params.cq_off.tail);
+    ring.cq_mask = (unsigned int*)(cq + params.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    ring.times = (struct __kernel_timespec*)calloc (
+        params.sq_entries, sizeof (struct __kernel_timespec));
+    if (ring.times == NULL)
+        errno_abort ("Allocate timeouts");
+    ring.tail = *ring.sq_tail;
+    return 1;
+}
+
+/*
+ * Hand every queued request to the kernel, and wait for "wait"
+ * completions.
+ */
+void uring_submit (unsigned int wait)
+{
+    int result;
+
+    __atomic_store_n (ring.sq_tail, ring.tail, __ATOMIC_RELEASE);
+    do {
+        uring_enters++;
+        result = syscall (__NR_io_uring_enter, ring.fd,
+            ring.tail - __atomic_load_n (ring.sq_head, __ATOMIC_ACQUIRE),
+            wait, wait != 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (result < 0 && errno == EINTR);
+    if (result < 0)
+        errno_abort ("Enter io_uring");
+}
+
+/*
+ * Take the next free request slot, submitting what is queued if
+ * there is none, and clear it. Returns the slot number.
+ */
+static unsigned int uring_slot (uint64_t tag)
+{
+    unsigned int slot;
+
+    while (ring.tail - __atomic_load_n (ring.sq_head, __ATOMIC_ACQUIRE)
+        > *ring.sq_mask)
+        uring_submit (0);
+    slot = ring.tail++ & *ring.sq_mask;
+    memset (&ring.sqes[slot], 0, sizeof (struct io_uring_sqe));
+    ring.sqes[slot].user_data = tag;
+    ring.sq_array[slot] = slot;
+    return slot;
+}
+
+/*
+ * Reads and writes go at the current file position (offset -1),
+ * so they work on pipes and terminals as well as files.
+ */
+void uring_read (int fd, void *buffer, size_t length, uint64_t tag)
+{
+    struct io_uring_sqe *sqe = &ring.sqes[uring_slot (tag)];
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t)buffer;
+    sqe->len = length;
+    sqe->off = (uint64_t)-1;
+}
+
+void uring_write (int fd, const void *buffer, size_t length, uint64_t tag)
+{
+    struct io_uring_sqe *sqe = &ring.sqes[uring_slot (tag)];
+
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t)buffer;
+    sqe->len = length;
+    sqe->off = (uint64_t)-1;
+}
+
+void uring_timeout (uint64_t when, uint64_t tag)
+{
+    unsigned int slot = uring_slot (tag);
+    struct io_uring_sqe *sqe = &ring.sqes[slot];
+
+    ring.times[slot].tv_sec = when / NSEC_PER_SEC;
+    ring.times[slot].tv_nsec = when % NSEC_PER_SEC;
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (uintptr_t)&ring.times[slot];
+    sqe->len = 1;
+    sqe->timeout_flags = IORING_TIMEOUT_ABS;
+}
+
+void uring_cancel (uint64_t timeout_tag, uint64_t tag)
+{
+    struct io_uring_sqe *sqe = &ring.sqes[uring_slot (tag)];
+
+    sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = timeout_tag;
+}
+
+/*
+ * Take one completion, if there is one.
+ */
+int uring_complete (uint64_t *tag, int *result)
+{
+    unsigned int head = *ring.cq_head;
+    struct io_uring_cqe *cqe;
+
+    if (head == __atomic_load_n (ring.cq_tail, __ATOMIC_ACQUIRE))
+        return 0;
+    cqe = &ring.cqes[head & *ring.cq_mask];
+    *tag = cqe->user_data;
+    *result = cqe->res;
+    __atomic_store_n (ring.cq_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+#else
+/*
+ * Without io_uring there is never a ring, so nothing else is
+ * ever called.
+ */
+int uring_init (unsigned int entries)
+{
+    return 0;
+}
+
+void uring_read (int fd, void *buffer, size_t length, uint64_t tag)
+{
+}
+
+void uring_write (int fd, const void *buffer, size_t length, uint64_t tag)
+{
+}
+
+void uring_timeout (uint64_t when, uint64_t tag)
+{
+}
+
+void uring_cancel (uint64_t timeout_tag, uint64_t tag)
+{
+}
+
+void uring_submit (unsigned int wait)
+{
+}
+
+int uring_complete (uint64_t *tag, int *result)
+{
+    return 0;
+}
+#endif
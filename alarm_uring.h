@@ -0,0 +1,44 @@
+#ifndef __alarm_uring_h
+#define __alarm_uring_h
+
+#include "alarm.h"
+
+/*
+ * A minimal io_uring for the single-threaded event loop, driven
+ * through the raw system calls so that liburing is not needed.
+ * There is a single ring, used by one thread only.
+ *
+ * uring_read, uring_write, uring_timeout and uring_cancel each
+ * queue one request, tagged with "tag"; nothing reaches the kernel
+ * until uring_submit, which hands over everything queued and waits
+ * for at least "wait" completions with a single io_uring_enter.
+ * uring_complete then takes the completions one at a time: the
+ * tag, and the result a system call would have returned, with
+ * -errno for an error. Timeouts are absolute CLOCK_MONOTONIC
+ * times in nanoseconds, like deadlines (see alarm.h); one that
+ * expires completes with -ETIME, one that is cancelled with
+ * -ECANCELED.
+ *
+ * HAVE_URING is defined when the kernel headers have io_uring.
+ * Without them, or when the kernel refuses to set up a ring,
+ * uring_init returns 0 and the caller carries on without it.
+ * uring_enters counts the io_uring_enter calls made.
+ */
+#if defined (__linux__) && defined (__has_include)
+# if __has_include (<linux/io_uring.h>)
+#  define HAVE_URING
+# endif
+#endif
+
+extern unsigned long uring_enters;
+
+extern int uring_init (unsigned int entries);
+extern void uring_read (int fd, void *buffer, size_t length, uint64_t tag);
+extern void uring_write (
+    int fd, const void *buffer, size_t length, uint64_t tag);
+extern void uring_timeout (uint64_t when, uint64_t tag);
+extern void uring_cancel (uint64_t timeout_tag, uint64_t tag);
+extern void uring_submit (unsigned int wait);
+extern int uring_complete (uint64_t *tag, int *result);
+
+#endif
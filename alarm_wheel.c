@@ -0,0 +1,345 @@
+/*
+ * alarm_wheel.c
+ *
+ * Hierarchical timing wheel used as the alarm store. See
+ * alarm_wheel.h for the layout of the levels.
+ */
+#include <stddef.h>
+#include "alarm_wheel.h"
+
+static const int wheel_size[WHEEL_LEVELS] = {
+    1000, 60, 60, 24, WHEEL_DAYS };
+static const uint64_t wheel_width[WHEEL_LEVELS] = {
+    1, 1000, 60 * 1000, 60 * 60 * 1000, 24 * 60 * 60 * 1000 };
+static const int wheel_base[WHEEL_LEVELS] = {
+    0, 1000, 1060, 1120, 1144 };
+
+#define WHEEL_TOP       (WHEEL_LEVELS - 1)
+
+/*
+ * Link an alarm at the head of a list, remembering the list so
+ * that it can be unlinked later without a search.
+ */
+static void list_push (alarm_t **head, alarm_t *alarm)
+{
+    alarm->bucket = head;
+    alarm->prev = NULL;
+    alarm->link = *head;
+    if (*head != NULL)
+        (*head)->prev = alarm;
+    *head = alarm;
+}
+
+static void list_unlink (alarm_t *alarm)
+{
+    if (alarm->prev != NULL)
+        alarm->prev->link = alarm->link;
+    else
+        *alarm->bucket = alarm->link;
+    if (alarm->link != NULL)
+        alarm->link->prev = alarm->prev;
+    alarm->link = alarm->prev = NULL;
+    alarm->bucket = NULL;
+}
+
+/*
+ * Return the first occupied slot in [from, to), or -1.
+ */
+static int bitmap_find (wheel_t *wheel, int from, int to)
+{
+    int word;
+    uint64_t bits;
+
+    while (from < to) {
+        word = from / 64;
+        bits = wheel->occupied[word] >> (from % 64);
+        if (bits != 0) {
+            from += __builtin_ctzll (bits);
+            return from < to ? from : -1;
+        }
+        from = (word + 1) * 64;
+    }
+    return -1;
+}
+
+/*
+ * Link an alarm into a slot, keeping the level count and the
+ * occupied bitmap up to date.
+ */
+static void slot_push (wheel_t *wheel, int level, int index, alarm_t *alarm)
+{
+    list_push (&wheel->slots[index], alarm);
+    wheel->occupied[index / 64] |= 1ULL << (index % 64);
+    wheel->level_count[level]++;
+}
+
+/*
+ * Unlink an alarm from whichever list holds it. If that is a slot
+ * (rather than the expired or overflow list), keep the level
+ * count and the occupied bitmap up to date.
+ */
+static void wheel_unlink (wheel_t *wheel, alarm_t *alarm)
+{
+    alarm_t **bucket = alarm->bucket;
+    ptrdiff_t index;
+    int level;
+
+    list_unlink (alarm);
+    if (bucket < wheel->slots || bucket >= wheel->slots + WHEEL_SLOTS)
+        return;
+    index = bucket - wheel->slots;
+    for (level = WHEEL_TOP; level > 0; level--)
+        if (index >= wheel_base[level])
+            break;
+    wheel->level_count[level]--;
+    if (*bucket == NULL)
+        wheel->occupied[index / 64] &= ~(1ULL << (index % 64));
+}
+
+/*
+ * Place an alarm in the lowest level whose current period
+ * contains its expiration tick. An alarm that is already due
+ * goes into the current level 0 slot, where the next call to
+ * wheel_expire will find it.
+ */
+static void wheel_place (wheel_t *wheel, alarm_t *alarm)
+{
+    uint64_t when = alarm->time / WHEEL_TICK;
+    uint64_t period;
+    int level;
+
+    if (when < wheel->now)
+        when = wheel->now;
+    for (level = 0; level < WHEEL_TOP; level++) {
+        period = wheel_width[level] * wheel_size[level];
+        if (when / period == wheel->now / period)
+            break;
+    }
+    if (level == WHEEL_TOP
+        && when / wheel_width[WHEEL_TOP] - wheel->now / wheel_width[WHEEL_TOP]
+            >= (uint64_t)wheel_size[WHEEL_TOP]) {
+        list_push (&wheel->overflow, alarm);
+        return;
+    }
+    slot_push (wheel, level, wheel_base[level]
+        + (when / wheel_width[level]) % wheel_size[level], alarm);
+}
+
+/*
+ * Redistribute the alarms in one slot of a higher level. Called
+ * when the wheel reaches the start of that slot's period.
+ */
+static void wheel_cascade (wheel_t *wheel, int level)
+{
+    alarm_t **head, *alarm;
+
+    head = &wheel->slots[wheel_base[level]
+        + (wheel->now / wheel_width[level]) % wheel_size[level]];
+    while ((alarm = *head) != NULL) {
+        wheel_unlink (wheel, alarm);
+        wheel_place (wheel, alarm);
+    }
+}
+
+/*
+ * Move every alarm in the current level 0 slot whose deadline
+ * has passed at "now" (nanoseconds) onto the expired list.
+ */
+static void wheel_collect (wheel_t *wheel, uint64_t now)
+{
+    alarm_t *alarm, *next;
+
+    alarm = wheel->slots[wheel->now % wheel_size[0]];
+    while (alarm != NULL) {
+        next = alarm->link;
+        if (alarm->time <= now) {
+            wheel_unlink (wheel, alarm);
+            list_push (&wheel->expired, alarm);
+        }
+        alarm = next;
+    }
+}
+
+/*
+ * Return the tick at which the first occupied slot after the
+ * current tick begins, looking at the lowest levels first, or 0
+ * if there is none. If only the overflow list is occupied, that
+ * is the next day boundary, where it is looked at again.
+ */
+static uint64_t wheel_next_tick (wheel_t *wheel)
+{
+    int level, base, size, cur, index;
+    uint64_t offset;
+
+    for (level = 0; level < WHEEL_LEVELS; level++) {
+        if (wheel->level_count[level] == 0)
+            continue;
+        base = wheel_base[level];
+        size = wheel_size[level];
+        cur = (wheel->now / wheel_width[level]) % size;
+        index = bitmap_find (wheel, base + cur + 1, base + size);
+        if (index >= 0)
+            offset = index - base - cur;
+        else if (level == WHEEL_TOP
+            && (index = bitmap_find (wheel, base, base + cur)) >= 0)
+            offset = index - base + size - cur;
+        else
+            continue;
+        return (wheel->now / wheel_width[level] + offset)
+            * wheel_width[level];
+    }
+    if (wheel->overflow != NULL)
+        return (wheel->now / wheel_width[WHEEL_TOP] + 1)
+            * wheel_width[WHEEL_TOP];
+    return 0;
+}
+
+/*
+ * Advance the wheel to "now" (nanoseconds), cascading higher
+ * levels at each boundary crossed. The wheel jumps straight from
+ * one occupied slot to the next, so an idle or sparse wheel does
+ * not have to visit every millisecond.
+ */
+static void wheel_advance (wheel_t *wheel, uint64_t now)
+{
+    uint64_t target = now / WHEEL_TICK, next;
+    alarm_t *alarm, *link;
+    int level;
+
+    if (wheel->count == 0) {
+        if (target > wheel->now)
+            wheel->now = target;
+        return;
+    }
+    wheel_collect (wheel, now);
+    while (wheel->now < target) {
+        next = wheel_next_tick (wheel);
+        if (next == 0 || next > target) {
+            wheel->now = target;
+            break;
+        }
+        wheel->now = next;
+        for (level = WHEEL_TOP; level > 0; level--) {
+            if (wheel->now % wheel_width[level] != 0)
+                continue;
+            if (level == WHEEL_TOP) {
+                for (alarm = wheel->overflow; alarm != NULL; alarm = link) {
+                    link = alarm->link;
+                    list_unlink (alarm);
+                    wheel_place (wheel, alarm);
+                }
+            }
+            wheel_cascade (wheel, level);
+        }
+        wheel_collect (wheel, now);
+    }
+}
+
+void wheel_init (wheel_t *wheel, uint64_t now)
+{
+    int i;
+
+    wheel->now = now / WHEEL_TICK;
+    wheel->count = 0;
+    for (i = 0; i < WHEEL_LEVELS; i++)
+        wheel->level_count[i] = 0;
+    wheel->expired = NULL;
+    wheel->overflow = NULL;
+    for (i = 0; i < WHEEL_SLOTS; i++)
+        wheel->slots[i] = NULL;
+    for (i = 0; i < (WHEEL_SLOTS + 63) / 64; i++)
+        wheel->occupied[i] = 0;
+}
+
+void wheel_insert (wheel_t *wheel, alarm_t *alarm)
+{
+    wheel_place (wheel, alarm);
+    wheel->count++;
+}
+
+void wheel_remove (wheel_t *wheel, alarm_t *alarm)
+{
+    wheel_unlink (wheel, alarm);
+    wheel->count--;
+}
+
+/*
+ * Remove every alarm that is due at "now" and return them as a
+ * list chained through alarm->link, or NULL if none is. The
+ * expired list is detached whole, so the caller gets the entire
+ * run of due alarms at once.
+ */
+alarm_t *wheel_expire (wheel_t *wheel, uint64_t now)
+{
+    alarm_t *head, *alarm;
+
+    wheel_advance (wheel, now);
+    head = wheel->expired;
+    wheel->expired = NULL;
+    for (alarm = head; alarm != NULL; alarm = alarm->link) {
+        alarm->prev = NULL;
+        alarm->bucket = NULL;
+        wheel->count--;
+    }
+    return head;
+}
+
+/*
+ * Find the time at which the wheel next needs attention: the
+ * exact deadline of the earliest alarm in level 0, or else the
+ * start of the first occupied slot of a higher level (at which
+ * point it will be cascaded). Returns 0 if the wheel is empty.
+ */
+int wheel_next (wheel_t *wheel, uint64_t *when)
+{
+    uint64_t best, tick;
+    alarm_t *alarm;
+    int index;
+
+    if (wheel->count == 0)
+        return 0;
+    *when = wheel->now * WHEEL_TICK;
+    if (wheel->expired != NULL)
+        return 1;
+    if (wheel->level_count[0] != 0) {
+        index = bitmap_find (wheel, wheel->now % wheel_size[0], wheel_size[0]);
+        if (index >= 0) {
+            alarm = wheel->slots[index];
+            best = alarm->time;
+            for (; alarm != NULL; alarm = alarm->link)
+                if (alarm->time < best)
+                    best = alarm->time;
+            *when = best;
+            return 1;
+        }
+    }
+    tick = wheel_next_tick (wheel);
+    if (tick != 0)
+        *when = tick * WHEEL_TICK;
+    return 1;
+}
+
+/*
+ * Call "fn" for every alarm in the wheel, in no particular order.
+ */
+void wheel_foreach (
+    wheel_t *wheel, void (*fn)(alarm_t *, void *), void *arg)
+{
+    alarm_t *alarm, *link;
+    int i;
+
+    for (alarm = wheel->expired; alarm != NULL; alarm = link) {
+        link = alarm->link;
+        fn (alarm, arg);
+    }
+    for (i = 0; i < WHEEL_SLOTS; i++) {
+        for (alarm = wheel->slots[i]; alarm != NULL; alarm = link) {
+            link = alarm->link;
+            fn (alarm, arg);
+        }
+    }
+    for (alarm = wheel->overflow; alarm != NULL; alarm = link) {
+        link = alarm->link;
+        fn (alarm, arg);
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef __alarm_wheel_h
+#define __alarm_wheel_h
+
+#include "alarm.h"
+
+/*
+ * A hierarchical timing wheel. The wheel ticks once per
+ * millisecond. Level 0 has one slot per millisecond of the
+ * current second, level 1 one slot per second of the current
+ * minute, level 2 one slot per minute of the current hour, level
+ * 3 one slot per hour of the current day and level 4 one slot per
+ * day. Alarms further away than WHEEL_DAYS wait on an overflow
+ * list. Whenever the wheel crosses a second, minute, hour or day
+ * boundary the matching slot of the higher level is "cascaded":
+ * its alarms are redistributed into the lower levels.
+ *
+ * Alarms keep their exact nanosecond deadlines; a level 0 slot
+ * only groups the alarms due within the same millisecond, and
+ * each of them is handed out once its own deadline has passed.
+ *
+ * Insertion and removal are O(1); each alarm is cascaded at most
+ * once per level, so expiry is O(1) amortized. A bitmap of
+ * occupied slots lets wheel_next find the next occupied slot
+ * without visiting the empty ones.
+ */
+#define WHEEL_TICK      NSEC_PER_MSEC
+#define WHEEL_LEVELS    5
+#define WHEEL_DAYS      64
+#define WHEEL_SLOTS     (1000 + 60 + 60 + 24 + WHEEL_DAYS)
+
+typedef struct wheel_tag {
+    uint64_t            now;        /* current tick (ms) */
+    int                 count;      /* alarms held, including expired */
+    int                 level_count[WHEEL_LEVELS];
+    alarm_t             *expired;   /* due, waiting to be expired */
+    alarm_t             *overflow;  /* beyond the last level */
+    alarm_t             *slots[WHEEL_SLOTS];
+    uint64_t            occupied[(WHEEL_SLOTS + 63) / 64];
+} wheel_t;
+
+extern void wheel_init (wheel_t *wheel, uint64_t now);
+extern void wheel_insert (wheel_t *wheel, alarm_t *alarm);
+extern void wheel_remove (wheel_t *wheel, alarm_t *alarm);
+extern alarm_t *wheel_expire (wheel_t *wheel, uint64_t now);
+extern int wheel_next (wheel_t *wheel, uint64_t *when);
+extern void wheel_foreach (
+    wheel_t *wheel, void (*fn)(alarm_t *, void *), void *arg);
+
+#endif
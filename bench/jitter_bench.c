@@ -0,0 +1,136 @@
+/*
+ * jitter_bench.c
+ *
+ * Fire-time jitter against delivery cost. A timing thread, like
+ * an alarm thread, sleeps until each of a run of alarms is due,
+ * one every "spacing" microseconds, and notes how late it woke.
+ * Each alarm is then delivered, at a cost that goes up from run
+ * to run: either inline, by the timing thread itself, as the
+ * alarm threads do without -w, or by handing it to a pool of
+ * display workers (alarm_display.h). Inline, an expensive
+ * delivery makes every later alarm late; with the pool the
+ * lateness should stay flat.
+ *
+ * The cost is spent asleep, like a delivery that blocks on a
+ * slow write, so that the workers do not compete with the timing
+ * thread for the CPU and the result means the same on a machine
+ * with few cores.
+ *
+ * From the top of the tree:
+ *
+ *      cc -O2 -I. bench/jitter_bench.c alarm_display.c alarm_slab.c \
+ *         alarm.c -lpthread -o jitter_bench
+ *      ./jitter_bench [alarms [spacing [workers]]]
+ *
+ * The defaults are 500 alarms, 1000us apart, and at most 8
+ * workers, one for each of the alarms' 8 types.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "alarm.h"
+#include "alarm_slab.h"
+#include "alarm_display.h"
+
+#define TYPES           8
+
+static const long costs[] = { 0, 100, 500, 2000 };   /* us per alarm */
+#define COSTS           (sizeof (costs) / sizeof (costs[0]))
+
+static long cost;                   /* of the current run, in us */
+static unsigned long delivered;
+
+static void deliver (alarm_t *batch)
+{
+    struct timespec pause;
+    alarm_t *next;
+
+    pause.tv_sec = cost / 1000000;
+    pause.tv_nsec = cost % 1000000 * 1000;
+    for (; batch != NULL; batch = next) {
+        next = batch->link;
+        if (cost != 0)
+            nanosleep (&pause, NULL);
+        alarm_free (batch);
+        __atomic_fetch_add (&delivered, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static int compare_late (const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Time "count" alarms and deliver each one inline or through the
+ * pool. Prints the mean, 99th percentile and worst lateness.
+ */
+static void run (const char *mode, int pool, int count, long spacing,
+    uint64_t *late)
+{
+    struct timespec due;
+    alarm_t *alarm;
+    uint64_t start, deadline, now, total = 0;
+    int i;
+
+    delivered = 0;
+    start = alarm_now ();
+    for (i = 0; i < count; i++) {
+        deadline = start + (i + 1) * spacing * NSEC_PER_USEC;
+        due.tv_sec = deadline / NSEC_PER_SEC;
+        due.tv_nsec = deadline % NSEC_PER_SEC;
+        while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL)
+            != 0)
+            ;
+        now = alarm_now ();
+        late[i] = now > deadline ? now - deadline : 0;
+        total += late[i];
+        alarm = alarm_alloc ();
+        alarm->type = i % TYPES;
+        alarm->time = deadline;
+        alarm->link = NULL;
+        if (pool)
+            display_submit (0, alarm);
+        else
+            deliver (alarm);
+    }
+
+    // let the pool finish before the next run changes the cost
+    while (__atomic_load_n (&delivered, __ATOMIC_RELAXED) < (unsigned long)count)
+        sched_yield ();
+    qsort (late, count, sizeof (uint64_t), compare_late);
+    printf ("%-6s %5ldus  mean %9.1fus  p99 %9.1fus  max %9.1fus\n",
+        mode, cost, (double)total / count / NSEC_PER_USEC,
+        (double)late[count * 99 / 100] / NSEC_PER_USEC,
+        (double)late[count - 1] / NSEC_PER_USEC);
+}
+
+int main (int argc, char *argv[])
+{
+    int count = argc > 1 ? atoi (argv[1]) : 500;
+    long spacing = argc > 2 ? atol (argv[2]) : 1000;
+    int workers = argc > 3 ? atoi (argv[3]) : 8;
+    uint64_t *late;
+    size_t i;
+
+    late = (uint64_t*)malloc (count * sizeof (uint64_t));
+    if (count < 1 || spacing < 1 || workers < 1 || late == NULL) {
+        fprintf (stderr, "usage: %s [alarms [spacing [workers]]]\n",
+            argv[0]);
+        return 1;
+    }
+    display_start (workers, 1, deliver);
+    for (i = 0; i < TYPES; i++)     // start the workers before timing
+        display_route (i);
+    printf ("%d alarms %ldus apart, at most %d workers; lateness by cost:\n",
+        count, spacing, workers);
+    for (i = 0; i < COSTS; i++) {
+        cost = costs[i];
+        run ("inline", 0, count, spacing, late);
+        run ("pool", 1, count, spacing, late);
+    }
+    return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * json_bench.c
+ *
+ * Micro-benchmark for the output formatters. Formats "expired"
+ * events for a mix of alarms into a reusable buffer over and
+ * over: as the text lines the alarm threads print, as the JSON
+ * lines written with -j, and as the same JSON made with snprintf
+ * (without escaping the strings, so it is, if anything, too
+ * fast). Reports events per second for each.
+ *
+ * From the top of the tree:
+ *
+ *      cc -O2 -I. bench/json_bench.c alarm_json.c alarm.c \
+ *         -o json_bench
+ *      ./json_bench [events]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "alarm.h"
+#include "alarm_json.h"
+
+static const struct sample_tag {
+    int                 alarm_id;
+    const char          *type;
+    uint64_t            duration;
+    const char          *message;
+} sample[] = {
+    { 2345, "14", 250 * NSEC_PER_MSEC, "Take the bread out of the oven" },
+    { 17, "2", 30 * NSEC_PER_SEC, "padded with whitespace" },
+    { -1, "", 10 * NSEC_PER_SEC, "Legacy alarm with a longer message than most" },
+    { 99, "build", 1500 * NSEC_PER_MSEC, "Needs \"quotes\" and a \\ escaped" },
+};
+#define SAMPLES (sizeof (sample) / sizeof (sample[0]))
+
+/*
+ * Both formatters fill the same buffer, and hand it over (here:
+ * count its bytes) whenever it might not have room for another
+ * event, as batch_deliver does.
+ */
+static char output[16384];
+static size_t total;
+
+static size_t text_format (char *buffer, const struct sample_tag *alarm,
+    uint64_t mono, uint64_t wall)
+{
+    char duration[32];
+
+    (void)mono;                 // the text line carries no times
+    (void)wall;
+    return snprintf (buffer, sizeof (output), "(%s) %s\n",
+        duration_format (duration, sizeof (duration), alarm->duration),
+        alarm->message);
+}
+
+static size_t json_format (char *buffer, const struct sample_tag *alarm,
+    uint64_t mono, uint64_t wall)
+{
+    json_t out;
+
+    json_begin (&out, buffer, "expired", mono, wall);
+    json_int (&out, "alarm_id", alarm->alarm_id);
+    json_string (&out, "type", alarm->type);
+    json_uint (&out, "duration_ns", alarm->duration);
+    json_uint (&out, "deadline_ns", mono - 1000);
+    json_string (&out, "message", alarm->message);
+    return json_end (&out);
+}
+
+static size_t printf_format (char *buffer, const struct sample_tag *alarm,
+    uint64_t mono, uint64_t wall)
+{
+    return snprintf (buffer, JSON_LINE, "{\"event\":\"expired\","
+        "\"mono_ns\":%llu,\"wall_ns\":%llu,\"alarm_id\":%d,"
+        "\"type\":\"%s\",\"duration_ns\":%llu,\"deadline_ns\":%llu,"
+        "\"message\":\"%s\"}\n", (unsigned long long)mono,
+        (unsigned long long)wall, alarm->alarm_id, alarm->type,
+        (unsigned long long)alarm->duration,
+        (unsigned long long)(mono - 1000), alarm->message);
+}
+
+static double run (size_t (*format)(char *, const struct sample_tag *,
+    uint64_t, uint64_t), long events)
+{
+    struct timespec start, end;
+    size_t length = 0;
+    uint64_t mono = alarm_now (), wall = alarm_wall ();
+    long i;
+
+    clock_gettime (CLOCK_MONOTONIC, &start);
+    for (i = 0; i < events; i++) {
+        if (length > sizeof (output) - JSON_LINE) {
+            total += length;
+            length = 0;
+        }
+        length += format (output + length, &sample[i % SAMPLES],
+            mono + i, wall + i);
+    }
+    total += length;
+    clock_gettime (CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec)
+        + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main (int argc, char *argv[])
+{
+    long events = argc > 1 ? atol (argv[1]) : 5000000;
+    double text_time, json_time, printf_time;
+    size_t text_bytes, json_bytes;
+
+    text_time = run (text_format, events);
+    text_bytes = total;
+    total = 0;
+    json_time = run (json_format, events);
+    json_bytes = total;
+    printf_time = run (printf_format, events);
+    printf ("text:          %10.0f events/s, %5.1f bytes/event\n",
+        events / text_time, (double)text_bytes / events);
+    printf ("json:          %10.0f events/s, %5.1f bytes/event\n",
+        events / json_time, (double)json_bytes / events);
+    printf ("json snprintf: %10.0f events/s (json is %.1fx faster)\n",
+        events / printf_time, printf_time / json_time);
+    return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * parse_bench.c
+ *
+ * Micro-benchmark for the command parser. Parses a mix of command
+ * lines over and over, first the way main() used to (trim the
+ * line into a copy, then try each sscanf format in turn) and then
+ * with parse_line, and reports lines per second for each.
+ *
+ * From the top of the tree:
+ *
+ *      cc -O2 -I. bench/parse_bench.c alarm_parse.c alarm.c \
+ *         -o parse_bench
+ *      ./parse_bench [lines]
+ */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "alarm.h"
+#include "alarm_parse.h"
+
+static const char *sample[] = {
+    "Start_Alarm(2345): T14 250ms Take the bread out of the oven\n",
+    "Change_Alarm(2345): T3 1.5 Bread is fine, check again\n",
+    "Cancel_Alarm(2345)\n",
+    "View_Alarms()\n",
+    "10 Legacy alarm with a longer message than most\n",
+    "  Start_Alarm(17):   T2   30   padded with whitespace   \n",
+    "Stop_Alarm(1)\n",
+};
+#define SAMPLES (sizeof (sample) / sizeof (sample[0]))
+
+/*
+ * The old path, as it was in main().
+ */
+static char *trimwhitespace (char *str)
+{
+    char *end;
+
+    while (isspace ((unsigned char)*str)) str++;
+    if (*str == 0)
+        return str;
+    end = str + strlen (str) - 1;
+    while (end > str && isspace ((unsigned char)*end)) end--;
+    end[1] = '\0';
+    return str;
+}
+
+static int sscanf_parse (char *sline)
+{
+    char line[128], type[65], duration_text[32], message[64];
+    uint64_t duration;
+    int alarm_id;
+
+    strcpy (line, trimwhitespace (sline));
+    if (sscanf (line, "Start_Alarm(%d): T%64s %31s %63[^\n]",
+        &alarm_id, type, duration_text, message) > 3
+        && duration_parse (duration_text, &duration))
+        return PARSE_START;
+    if (sscanf (line, "Change_Alarm(%d): T%64s %31s %63[^\n]",
+        &alarm_id, type, duration_text, message) > 3
+        && duration_parse (duration_text, &duration))
+        return PARSE_CHANGE;
+    if (sscanf (line, "Cancel_Alarm(%d)", &alarm_id) == 1)
+        return PARSE_CANCEL;
+    if (strcmp (line, "View_Alarms()") == 0)
+        return PARSE_VIEW;
+    if (sscanf (line, "%31s %63[^\n]", duration_text, message) < 2
+        || !duration_parse (duration_text, &duration))
+        return PARSE_BAD;
+    return PARSE_LEGACY;
+}
+
+static int line_parse (char *sline)
+{
+    parse_t parse;
+
+    return parse_line (sline, &parse);
+}
+
+/*
+ * Both parsers modify the line, so each iteration starts from a
+ * fresh copy, as it would after fgets.
+ */
+static double run (int (*parse)(char *), long lines, long *kinds)
+{
+    char sline[128];
+    struct timespec start, end;
+    long i;
+
+    clock_gettime (CLOCK_MONOTONIC, &start);
+    for (i = 0; i < lines; i++) {
+        strcpy (sline, sample[i % SAMPLES]);
+        kinds[parse (sline)]++;
+    }
+    clock_gettime (CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec)
+        + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main (int argc, char *argv[])
+{
+    long lines = argc > 1 ? atol (argv[1]) : 5000000;
+    long old_kinds[PARSE_LEGACY + 1] = { 0 };
+    long new_kinds[PARSE_LEGACY + 1] = { 0 };
+    double old_time, new_time;
+    int i;
+
+    old_time = run (sscanf_parse, lines, old_kinds);
+    new_time = run (line_parse, lines, new_kinds);
+    for (i = 0; i <= PARSE_LEGACY; i++) {
+        if (old_kinds[i] != new_kinds[i]) {
+            fprintf (stderr, "Parsers disagree on kind %d: %ld vs %ld\n",
+                i, old_kinds[i], new_kinds[i]);
+            return 1;
+        }
+    }
+    printf ("sscanf:     %10.0f lines/s\n", lines / old_time);
+    printf ("parse_line: %10.0f lines/s (%.1fx)\n",
+        lines / new_time, old_time / new_time);
+    return 0;
+}
@@ -0,0 +1,173 @@
+/*
+ * skiplist_bench.c
+ *
+ * Scaling of the lock-free skip list store (alarm_skiplist.h)
+ * against a 4-ary heap behind a single mutex, the way the stores
+ * are used by one shard. For 1, 2, 4 ... 32 producer threads, each
+ * producer repeatedly starts an alarm that is already due, and
+ * starts and then cancels one far in the future, while one expiry
+ * thread keeps taking the due alarms out and freeing them.
+ * Reports store operations per second for each.
+ *
+ * From the top of the tree:
+ *
+ *      cc -O2 -I. bench/skiplist_bench.c alarm_skiplist.c \
+ *         alarm_heap.c alarm_slab.c alarm.c -lpthread -o skiplist_bench
+ *      ./skiplist_bench [operations [threads]]
+ *
+ * "operations" is per producer (default 300000), and "threads"
+ * the most producers to try (default 32).
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "errors.h"
+#include "alarm.h"
+#include "alarm_slab.h"
+#include "alarm_heap.h"
+#include "alarm_skiplist.h"
+
+static skiplist_t list;
+static heap_t heap;
+static pthread_mutex_t heap_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int locked;                  /* this run uses the heap */
+static long operations;
+static int producing;               /* producers still running */
+
+static void store_insert (alarm_t *alarm)
+{
+    if (!locked) {
+        skip_insert (&list, alarm);
+        return;
+    }
+    pthread_mutex_lock (&heap_mutex);
+    heap_insert (&heap, alarm);
+    pthread_mutex_unlock (&heap_mutex);
+}
+
+static void store_remove (alarm_t *alarm)
+{
+    if (!locked) {
+        skip_remove (&list, alarm);
+        return;
+    }
+    pthread_mutex_lock (&heap_mutex);
+    heap_remove (&heap, alarm);
+    pthread_mutex_unlock (&heap_mutex);
+}
+
+static alarm_t *store_expire (uint64_t now)
+{
+    alarm_t *batch;
+
+    if (!locked)
+        return skip_expire (&list, now);
+    pthread_mutex_lock (&heap_mutex);
+    batch = heap_expire (&heap, now);
+    pthread_mutex_unlock (&heap_mutex);
+    return batch;
+}
+
+static alarm_t *bench_alarm (int alarm_id, uint64_t time)
+{
+    alarm_t *alarm = alarm_alloc ();
+
+    alarm->alarm_id = alarm_id;
+    alarm->time = time;
+    return alarm;
+}
+
+/*
+ * Each operation is three store calls: an insert that the expiry
+ * thread will take, and an insert and a remove of our own.
+ */
+static void *producer (void *arg)
+{
+    int id = (int)(long)arg * operations;
+    uint64_t now = alarm_now ();
+    alarm_t *far;
+    long i;
+
+    for (i = 0; i < operations; i++) {
+        store_insert (bench_alarm (id + i, now));
+        far = bench_alarm (id + i, now + 3600 * NSEC_PER_SEC + i);
+        store_insert (far);
+        store_remove (far);
+        alarm_free (far);
+    }
+    __atomic_sub_fetch (&producing, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void *expirer (void *arg)
+{
+    alarm_t *batch, *next;
+    long *expired = (long*)arg;
+
+    while (1) {
+        // look once more after the last producer is done
+        int done = __atomic_load_n (&producing, __ATOMIC_ACQUIRE) == 0;
+
+        for (batch = store_expire (alarm_now ()); batch != NULL; batch = next) {
+            next = batch->link;
+            alarm_free (batch);
+            (*expired)++;
+        }
+        if (done)
+            return NULL;
+    }
+}
+
+static double run (int threads, long *expired)
+{
+    pthread_t thread[64], expiry;
+    struct timespec start, end;
+    int i, status;
+
+    producing = threads;
+    *expired = 0;
+    clock_gettime (CLOCK_MONOTONIC, &start);
+    status = pthread_create (&expiry, NULL, expirer, expired);
+    if (status != 0)
+        err_abort (status, "Create expiry thread");
+    for (i = 0; i < threads; i++) {
+        status = pthread_create (&thread[i], NULL, producer, (void*)(long)i);
+        if (status != 0)
+            err_abort (status, "Create producer");
+    }
+    for (i = 0; i < threads; i++)
+        pthread_join (thread[i], NULL);
+    pthread_join (expiry, NULL);
+    clock_gettime (CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main (int argc, char *argv[])
+{
+    int most = argc > 2 ? atoi (argv[2]) : 32, threads;
+    double calls, heap_time, skip_time;
+    long expired;
+
+    operations = argc > 1 ? atol (argv[1]) : 300000;
+    if (operations < 1 || most < 1 || most > 64) {
+        fprintf (stderr, "usage: %s [operations [threads]]\n", argv[0]);
+        return 1;
+    }
+    skip_init (&list);
+    heap_init (&heap);
+    printf ("threads   mutex+heap ops/s   skiplist ops/s\n");
+    for (threads = 1; threads <= most; threads *= 2) {
+        calls = 3.0 * operations * threads;
+        locked = 1;
+        heap_time = run (threads, &expired);
+        if (expired != operations * threads)
+            fprintf (stderr, "heap expired %ld alarms\n", expired);
+        locked = 0;
+        skip_time = run (threads, &expired);
+        if (expired != operations * threads)
+            fprintf (stderr, "skiplist expired %ld alarms\n", expired);
+        printf ("%7d   %16.0f   %14.0f\n", threads,
+            calls / heap_time, calls / skip_time);
+    }
+    return 0;
+}
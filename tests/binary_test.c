@@ -0,0 +1,147 @@
+/*
+ * binary_test.c
+ *
+ * Round trip through the binary framing (alarm_binary.h): frames
+ * made by binary_encode must have exactly the expected bytes, with
+ * the fields their opcode does not use zeroed whatever was passed
+ * for them, and must decode back to the same command. A negative
+ * alarm_id, which only legacy alarms have, is a bad command. A
+ * text type must come back from a frame as the same type: the
+ * alarm program turns a frame's type id back into text by
+ * printing it in decimal.
+ *
+ * From the top of the tree:
+ *
+ *      cc -I. tests/binary_test.c alarm_binary.c alarm_parse.c alarm.c \
+ *         -o binary_test
+ *      ./binary_test
+ */
+#include <stdio.h>
+#include <string.h>
+#include "alarm_binary.h"
+
+static int failures;
+
+/*
+ * Text commands and the type each is parsed to, or NULL if that
+ * type has no type id and cannot be encoded.
+ */
+static const struct {
+    const char          *line;
+    const char          *type;
+} types[] = {
+    { "Start_Alarm(1): T3 1 hi", "3" },
+    { "Start_Alarm(1): T03 1 hi", "3" },
+    { "Change_Alarm(1): T000 1 hi", "0" },
+    { "View_Alarms(T0065535)", "65535" },
+    { "Start_Alarm(1): T65536 1 hi", NULL },
+    { "Start_Alarm(1): T+3 1 hi", NULL },
+    { "View_Alarms(T3a)", NULL },
+};
+#define TYPES           (sizeof (types) / sizeof (types[0]))
+
+static void check (int ok, const char *what)
+{
+    if (!ok) {
+        printf ("binary_test: %s\n", what);
+        failures++;
+    }
+}
+
+/*
+ * Parse a text command, encode it as alarm_encode does, decode
+ * it, and compare the types.
+ */
+static void check_type (const char *line, const char *expected)
+{
+    char text[128], decoded[8];
+    unsigned char frame[BINARY_MAX];
+    binary_command_t command;
+    parse_t parse;
+    unsigned int id;
+    size_t length;
+    int opcode;
+
+    strcpy (text, line);
+    switch (parse_line (text, &parse)) {
+    case PARSE_START:
+        opcode = BINARY_START;
+        break;
+    case PARSE_CHANGE:
+        opcode = BINARY_CHANGE;
+        break;
+    default:
+        opcode = BINARY_VIEW_TYPE;
+        break;
+    }
+    if (expected == NULL) {
+        check (!binary_type (parse.type, &id), line);
+        return;
+    }
+    check (strcmp (parse.type, expected) == 0, line);
+    if (!binary_type (parse.type, &id)) {
+        check (0, line);
+        return;
+    }
+    length = binary_encode (frame, opcode, parse.alarm_id, id,
+        parse.duration, parse.message);
+    check (binary_decode (frame, length, &command) == (int)length
+        && command.parse.type_id >= 0, line);
+    snprintf (decoded, sizeof (decoded), "%d", command.parse.type_id);
+    check (strcmp (decoded, parse.type) == 0, line);
+}
+
+int main (void)
+{
+    static const unsigned char view[BINARY_HEADER] = { BINARY_VIEW };
+    static const unsigned char start[] = {
+        BINARY_START, 2, 0x34, 0x12, 0xfe, 0xff, 0xff, 0x7f,
+        0x00, 0xca, 0x9a, 0x3b, 0, 0, 0, 0, 'h', 'i'
+    };
+    unsigned char frame[BINARY_MAX];
+    binary_command_t command;
+    size_t length, i;
+
+    // a View after a Start: the Start's fields must not leak into it
+    length = binary_encode (frame, BINARY_VIEW, 42, 7,
+        1500000000, "left over");
+    check (length == sizeof (view), "View frame length");
+    check (memcmp (frame, view, sizeof (view)) == 0, "View frame bytes");
+    check (binary_decode (frame, length, &command) == (int)length,
+        "View frame does not decode");
+    check (command.parse.kind == PARSE_VIEW && command.parse.type == NULL
+        && command.parse.type_id == -1,
+        "View frame decodes as something else");
+    check (binary_decode (frame, length - 1, &command) == 0,
+        "short View frame decodes");
+
+    length = binary_encode (frame, BINARY_START, 0x7ffffffe, 0x1234,
+        1000000000, "hi");
+    check (length == sizeof (start), "Start frame length");
+    check (memcmp (frame, start, sizeof (start)) == 0, "Start frame bytes");
+    check (binary_decode (frame, length, &command) == (int)length,
+        "Start frame does not decode");
+    check (command.parse.kind == PARSE_START
+        && command.parse.alarm_id == 0x7ffffffe
+        && command.parse.type == NULL && command.parse.type_id == 0x1234
+        && command.parse.duration == 1000000000
+        && command.parse.duration_text == NULL
+        && strcmp (command.parse.message, "hi") == 0,
+        "Start frame decodes to different fields");
+
+    // -1 is the legacy alarms' alarm_id, not one a command may name
+    length = binary_encode (frame, BINARY_START, -1, 1, 1000000000, "hi");
+    check (binary_decode (frame, length, &command) == (int)length
+        && command.parse.kind == PARSE_BAD, "Start(-1) is not bad");
+    length = binary_encode (frame, BINARY_CANCEL, -1, 0, 0, NULL);
+    check (binary_decode (frame, length, &command) == (int)length
+        && command.parse.kind == PARSE_BAD, "Cancel(-1) is not bad");
+
+    for (i = 0; i < TYPES; i++)
+        check_type (types[i].line, types[i].type);
+
+    if (failures != 0)
+        return 1;
+    printf ("binary_test: ok\n");
+    return 0;
+}
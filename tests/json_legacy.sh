@@ -0,0 +1,25 @@
+#!/bin/sh
+#
+# json_legacy.sh
+#
+# With -j, a legacy alarm ("<duration> <message>") must report the
+# same events as one with an alarm_id: "inserted" when it is
+# stored and "expired" when it goes off, both with alarm_id -1.
+#
+# From the top of the tree, after building a.out as in the README:
+#
+#       sh tests/json_legacy.sh ./a.out
+#
+program=${1:-./a.out}
+
+output=$( (printf '0.1 legacy check\n'; sleep 0.5) | "$program" -j 2>/dev/null)
+for event in inserted expired; do
+    count=$(printf '%s\n' "$output" |
+        grep -c "^{\"event\":\"$event\",.*\"alarm_id\":-1,.*\"message\":\"legacy check\"}$")
+    if [ "$count" != 1 ]; then
+        echo "json_legacy: expected one \"$event\" event, got $count:"
+        printf '%s\n' "$output"
+        exit 1
+    fi
+done
+echo "json_legacy: ok"
@@ -0,0 +1,52 @@
+#!/bin/sh
+#
+# uring_split.sh
+#
+# "-1 -u" must not lose or reorder input when writing output
+# blocks while a read of stdin is in flight. stdout is read
+# slowly, and the first half of the alarms expire while the loop
+# waits for more input, so their messages fill both output
+# buffers with a read outstanding. The second half arrives in two
+# pieces, split in the middle of a line. Every Start_Alarm must
+# be inserted, and none may be a bad command. "-1" is checked the
+# same way, to compare.
+#
+# From the top of the tree, after building a.out as in the README
+# (Linux only):
+#
+#       sh tests/uring_split.sh ./a.out
+#
+program=${1:-./a.out}
+lines=6000
+half=3000
+directory=$(mktemp -d)
+trap 'rm -rf "$directory"' EXIT
+
+i=1
+while [ $i -le $lines ]; do
+    if [ $i -le $half ]; then duration=300ms; else duration=1000; fi
+    printf 'Start_Alarm(%d): T1 %s split read check %d\n' \
+        $i $duration $i
+    i=$((i + 1))
+done > "$directory/all"
+head -n $half "$directory/all" > "$directory/first"
+tail -n +$((half + 1)) "$directory/all" > "$directory/rest"
+size=$(wc -c < "$directory/rest")
+head -c $((size / 2 + 7)) "$directory/rest" > "$directory/rest.a"
+tail -c +$((size / 2 + 8)) "$directory/rest" > "$directory/rest.b"
+
+status=0
+for mode in "-1" "-1 -u"; do
+    output=$( (cat "$directory/first"; sleep 0.8; cat "$directory/rest.a";
+        sleep 3; cat "$directory/rest.b") |
+        "$program" $mode 2>/dev/null | (sleep 2; cat))
+    inserted=$(printf '%s\n' "$output" | grep -c 'Inserted by Main Thread')
+    bad=$(printf '%s\n' "$output" | grep -c 'Bad command')
+    if [ "$inserted" != $lines ] || [ "$bad" != 0 ]; then
+        echo "uring_split: $mode inserted $inserted of $lines," \
+            "$bad bad commands"
+        status=1
+    fi
+done
+[ $status = 0 ] && echo "uring_split: ok"
+exit $status
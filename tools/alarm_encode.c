@@ -0,0 +1,91 @@
+/*
+ * alarm_encode.c
+ *
+ * Encoder for the binary command protocol (see alarm_binary.h).
+ * Reads text commands on stdin, one per line, and writes the
+ * equivalent binary frames on stdout, ready to be piped into
+ * "a.out -b". Types must be numbers from 0 to 65535, since the
+ * binary protocol carries a type id rather than a string (see
+ * binary_type). Lines that cannot be encoded are reported on
+ * stderr and skipped.
+ *
+ * From the top of the tree:
+ *
+ *      cc -O2 -I. tools/alarm_encode.c alarm_binary.c alarm_parse.c \
+ *         alarm.c -o alarm_encode
+ *      ./alarm_encode < commands.txt > commands.bin
+ */
+#include <stdio.h>
+#include "alarm_binary.h"
+
+/*
+ * Convert a type to its id. Returns 0, after reporting it, if it
+ * is not a number in range.
+ */
+static int type_id (const char *text, int number, unsigned int *type)
+{
+    if (!binary_type (text, type)) {
+        fprintf (stderr, "%d: type \"%s\" is not a type id\n", number, text);
+        return 0;
+    }
+    return 1;
+}
+
+int main (void)
+{
+    char line[1024];
+    unsigned char frame[BINARY_MAX];
+    unsigned int type;
+    parse_t parse;
+    size_t length;
+    int number, opcode;
+
+    for (number = 1; fgets (line, sizeof (line), stdin) != NULL; number++) {
+        type = 0;
+        switch (parse_line (line, &parse)) {
+        case PARSE_EMPTY:
+            continue;
+        case PARSE_START:
+        case PARSE_CHANGE:
+            if (!type_id (parse.type, number, &type))
+                continue;
+            opcode = parse.kind == PARSE_START ? BINARY_START : BINARY_CHANGE;
+            break;
+        case PARSE_CANCEL:
+            opcode = BINARY_CANCEL;
+            break;
+        case PARSE_VIEW:
+            opcode = BINARY_VIEW;
+            if (parse.type == NULL)
+                break;
+            if (!type_id (parse.type, number, &type))
+                continue;
+            opcode = BINARY_VIEW_TYPE;
+            break;
+        case PARSE_BEGIN:
+            opcode = BINARY_BEGIN;
+            break;
+        case PARSE_COMMIT:
+            opcode = BINARY_COMMIT;
+            break;
+        case PARSE_STATS:
+            opcode = BINARY_STATS;
+            break;
+        case PARSE_LEGACY:
+            opcode = BINARY_LEGACY;
+            break;
+        default:
+            fprintf (stderr, "%d: Bad command\n", number);
+            continue;
+        }
+        // binary_encode zeroes whatever the opcode does not use,
+        // such as the fields parse_line left over from earlier lines
+        length = binary_encode (frame, opcode, parse.alarm_id,
+            type, parse.duration, parse.message);
+        if (fwrite (frame, 1, length, stdout) != length) {
+            perror ("Write frame");
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,162 @@
+/*
+ * alarm_load.c
+ *
+ * Load generator for the socket server (see alarm_server.h).
+ * Opens a number of connections to the server, each with a thread
+ * of its own, and has every connection send Start_Alarm and
+ * Cancel_Alarm commands for its own alarm_ids, WINDOW commands at
+ * a time, waiting for their acknowledgements before sending the
+ * next window. Reports commands per second for each number of
+ * connections; by default it tries 1, 16 and 256.
+ *
+ * From the top of the tree:
+ *
+ *      cc -O2 -I. tools/alarm_load.c alarm_binary.c alarm.c \
+ *         -lpthread -o alarm_load
+ *      a.out -l /tmp/alarm.sock &
+ *      ./alarm_load [-b] [-c commands] /tmp/alarm.sock [connections...]
+ *
+ * -b sends binary frames, for a server started with -b. -c sets
+ * the number of commands each connection sends (default 100000).
+ */
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "errors.h"
+#include "alarm_binary.h"
+
+#define WINDOW          64
+
+static const char *socket_path;
+static int binary = 0;
+static long commands = 100000;
+
+/*
+ * The command "number" for connection "client": alternately start
+ * an alarm far in the future and cancel it again, so the store
+ * stays small however long the run.
+ */
+static size_t encode (char *data, int client, long number)
+{
+    int alarm_id = (int)(client * commands + number / 2 + 1);
+
+    if (binary) {
+        if (number % 2 == 0)
+            return binary_encode ((unsigned char*)data, BINARY_START,
+                alarm_id, 1, 3600 * NSEC_PER_SEC, "load");
+        return binary_encode ((unsigned char*)data, BINARY_CANCEL,
+            alarm_id, 0, 0, NULL);
+    }
+    if (number % 2 == 0)
+        return sprintf (data, "Start_Alarm(%d): T1 3600 load\n", alarm_id);
+    return sprintf (data, "Cancel_Alarm(%d)\n", alarm_id);
+}
+
+static void *client_thread (void *arg)
+{
+    int client = (int)(long)arg;
+    struct sockaddr_un address;
+    char output[WINDOW * BINARY_MAX], input[4096];
+    size_t length;
+    ssize_t count;
+    long number = 0, acks, i;
+    int fd;
+
+    memset (&address, 0, sizeof (address));
+    address.sun_family = AF_UNIX;
+    strncpy (address.sun_path, socket_path, sizeof (address.sun_path) - 1);
+    fd = socket (AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        errno_abort ("Create socket");
+    if (connect (fd, (struct sockaddr*)&address, sizeof (address)) < 0)
+        errno_abort ("Connect to server");
+
+    while (number < commands) {
+        length = 0;
+        for (acks = 0; acks < WINDOW && number < commands; acks++)
+            length += encode (output + length, client, number++);
+        if (send (fd, output, length, MSG_NOSIGNAL) != (ssize_t)length)
+            errno_abort ("Send commands");
+        while (acks > 0) {
+            count = recv (fd, input, sizeof (input), 0);
+            if (count <= 0)
+                errno_abort ("Read acknowledgements");
+            for (i = 0; i < count; i++) {
+                if (input[i] == 'B') {
+                    fprintf (stderr, "Server rejected a command\n");
+                    exit (1);
+                }
+                if (input[i] == '\n')
+                    acks--;
+            }
+        }
+    }
+    close (fd);
+    return NULL;
+}
+
+static void run (int clients)
+{
+    pthread_t *threads;
+    struct timespec start, end;
+    double seconds;
+    int status, i;
+
+    threads = (pthread_t*)malloc (clients * sizeof (pthread_t));
+    if (threads == NULL)
+        errno_abort ("Allocate threads");
+    clock_gettime (CLOCK_MONOTONIC, &start);
+    for (i = 0; i < clients; i++) {
+        status = pthread_create (&threads[i], NULL,
+            client_thread, (void*)(long)i);
+        if (status != 0)
+            err_abort (status, "Create client thread");
+    }
+    for (i = 0; i < clients; i++) {
+        status = pthread_join (threads[i], NULL);
+        if (status != 0)
+            err_abort (status, "Join client thread");
+    }
+    clock_gettime (CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - start.tv_sec)
+        + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf ("%4d connections: %10.0f commands/s\n",
+        clients, clients * commands / seconds);
+    free (threads);
+}
+
+int main (int argc, char *argv[])
+{
+    static const int levels[] = { 1, 16, 256 };
+    int option, i;
+
+    while ((option = getopt (argc, argv, "bc:")) != -1) {
+        switch (option) {
+        case 'b':
+            binary = 1;
+            break;
+        case 'c':
+            commands = atol (optarg);
+            if (commands > 0)
+                break;
+            /* fall through */
+        default:
+            fprintf (stderr, "usage: %s [-b] [-c commands] socket"
+                " [connections...]\n", argv[0]);
+            exit (1);
+        }
+    }
+    if (optind >= argc) {
+        fprintf (stderr, "usage: %s [-b] [-c commands] socket"
+            " [connections...]\n", argv[0]);
+        exit (1);
+    }
+    socket_path = argv[optind++];
+    if (optind == argc)
+        for (i = 0; i < (int)(sizeof (levels) / sizeof (levels[0])); i++)
+            run (levels[i]);
+    else
+        for (; optind < argc; optind++)
+            run (atoi (argv[optind]));
+    return 0;
+}